@@ -7,7 +7,28 @@
  */ 
 
 #include "25AA1024.h"
+#if MEMXPORT == XPORT_TINYSPI
 #include "TinySPI.h"
+#endif
+#include <util/delay.h>
+#include <util/crc16.h>
+#include <string.h>
+
+#if ASYNC_USED
+#include <avr/interrupt.h>
+#endif
+
+#if CACHE_PAGES
+#include "25AA1024Cache.h"
+#endif
+
+#if PAGEMAP_USED
+#include "25AA1024Map.h"
+#endif
+
+#if WEAR_USED
+#include "25AA1024Wear.h"
+#endif
 
 
 /***********************************************************************
@@ -48,6 +69,393 @@ resume from the point when the HOLD was asserted.
 ************************************************************************/
 
 
+/************************************************************************
+Byte pump
+
+XferOut()/XferIn() move one byte over the bus with NO error checking,
+so they can sit in a tight loop.  Any failure is latched in XferErr, 
+which the caller checks once at the end of the transfer.
+
+MEMXPORT picks what's underneath:
+	XPORT_USI - we strobe the USI directly (three-wire mode, software 
+		clock) instead of going through TinySPI.  UNROLL_USED spells 
+		out all 16 clock strobes, which gets SCK up to F_CPU/4 at the 
+		cost of a few more words of flash.
+	XPORT_HWSPI - the SPI peripheral, master mode 0 with SPI2X, so 
+		SCK is F_CPU/2.  The pumps below keep the next byte ready 
+		while the current one shifts (see PumpRead).  With SCKCAL_USED
+		each chip gets its own divider (CalibrateSck), set by 
+		XportRate() whenever the chip is selected.
+	XPORT_TINYSPI - TinySPI's SPI_Write_Byte/SPI_Read_Byte.
+************************************************************************/
+static uint8_t	XferErr;		//	Nonzero if any Xfer since the last reset failed
+
+static MemReader*	ActiveReader;	//	Reader that may be holding !CS low (see ReaderRead)
+
+#if STATS_USED
+MemStats			MemStatsData[NUM_CHIPS];
+static short		StatChip;		//	Chip the pumps are talking to (set by BeginCommand)
+
+//	Opcode -> MemStats.commands[] index
+static inline uint8_t	StatOp( uint8_t Command )
+{
+	switch( Command )
+	{
+		case MREAD:		return 0;
+		case MWRITE:	return 1;
+		case MWREN:		return 2;
+		case MWRDI:		return 3;
+		case MRDSR:		return 4;
+		case MWRSR:		return 5;
+		case MPE:		return 6;
+		case MSE:		return 7;
+		case MCE:		return 8;
+		case MRDID:		return 9;
+		case MDPD:		return 10;
+	}
+	return STAT_OPS - 1;
+}
+#endif
+
+#if HOLD_USED
+static volatile uint8_t	HoldWanted;		//	MEMTRUE once MemBusRequest() has been called
+static MemYield			HoldFn;			//	Runs the other device's transfer (MemSetYield)
+static void*			HoldCtx;
+static void	HoldYield( void );
+#endif
+
+#if AUTOSLEEP_USED
+static uint8_t			PowerAsleep[NUM_CHIPS];		//	MEMTRUE if we put the chip in deep power-down
+static unsigned short	PowerIdle[NUM_CHIPS];		//	ms since the chip's last command
+#endif
+static void	ReaderSuspend( void );
+
+#if MEMXPORT == XPORT_USI
+
+#define USI_LO		((1<<USIWM0)|(1<<USITC))
+#define USI_HI		((1<<USIWM0)|(1<<USITC)|(1<<USICLK))
+
+static inline uint8_t	Xfer( uint8_t out )
+{
+	USIDR = out;
+	
+#if UNROLL_USED
+	USICR = USI_LO;	USICR = USI_HI;		//	bit 7
+	USICR = USI_LO;	USICR = USI_HI;
+	USICR = USI_LO;	USICR = USI_HI;
+	USICR = USI_LO;	USICR = USI_HI;
+	USICR = USI_LO;	USICR = USI_HI;
+	USICR = USI_LO;	USICR = USI_HI;
+	USICR = USI_LO;	USICR = USI_HI;
+	USICR = USI_LO;	USICR = USI_HI;		//	bit 0
+#else
+	USISR = (1<<USIOIF);
+	while( !(USISR & (1<<USIOIF)) )
+		USICR = (1<<USIWM0)|(1<<USICS1)|(1<<USICLK)|(1<<USITC);
+#endif
+
+	return USIDR;
+}
+
+static inline void		XferOut( uint8_t out )
+{
+	(void)Xfer( out );
+}
+
+static inline uint8_t	XferIn( void )
+{
+	return Xfer( 0xFF );
+}
+
+//	Three-wire mode, software clock - just needs DO and USCK as outputs
+static inline void		XportInit( void )
+{
+	USI_DDR |= (1<<USI_DO)|(1<<USI_USCK);
+}
+
+static inline void		XportRate( short chip )
+{
+	(void)chip;
+}
+
+#elif MEMXPORT == XPORT_HWSPI
+
+static inline uint8_t	Xfer( uint8_t out )
+{
+	SPDR = out;
+	while( !(SPSR & (1<<SPIF)) )
+		;
+	
+	return SPDR;
+}
+
+static inline void		XferOut( uint8_t out )
+{
+	(void)Xfer( out );
+}
+
+static inline uint8_t	XferIn( void )
+{
+	return Xfer( 0xFF );
+}
+
+//	Master, mode 0, MSB first, F_CPU/2
+static inline void		XportInit( void )
+{
+	HWSPI_DDR |= (1<<HWSPI_SS)|(1<<HWSPI_MOSI)|(1<<HWSPI_SCK);
+	SPCR = (1<<SPE)|(1<<MSTR);
+	SPSR = (1<<SPI2X);
+}
+
+#if SCKCAL_USED
+//	Rate r -> SPR1:0 and SPI2X, for F_CPU/2, /4, /8 ... /128
+static const uint8_t	SckSpr[SCK_RATES] = { 0, 0, 1, 1, 2, 2, 3 };
+static const uint8_t	Sck2x[SCK_RATES] = { 1, 0, 1, 0, 1, 0, 0 };
+static uint8_t			SckRate[NUM_CHIPS];		//	Each chip's rate (0 = fastest until calibrated)
+
+//	Switches the divider to the chip's rate.  Only while !CS is high.
+static inline void		XportRate( short chip )
+{
+	uint8_t	r = ((chip >= 0) && (chip < NUM_CHIPS)) ? SckRate[chip] : 0;
+	
+	SPCR = (SPCR & ~((1<<SPR1)|(1<<SPR0))) | SckSpr[r];
+	SPSR = Sck2x[r] << SPI2X;
+}
+#else
+static inline void		XportRate( short chip )
+{
+	(void)chip;
+}
+#endif
+
+#else	//	Go through TinySPI
+
+static inline void		XferOut( uint8_t out )
+{
+	if( SPI_Write_Byte( out ) )
+		XferErr = MEMTRUE;
+}
+
+static inline uint8_t	XferIn( void )
+{
+	short	temp;
+	
+	if( SPI_Read_Byte( SPIFALSE, &temp ) )
+		XferErr = MEMTRUE;
+	
+	return (uint8_t)temp;
+}
+
+//	TinySPI is set up by the application
+static inline void		XportInit( void )
+{
+}
+
+static inline void		XportRate( short chip )
+{
+	(void)chip;
+}
+
+#endif
+
+/************************************************************************
+Streams NumBytes in from the selected chip.  Errors are only checked 
+once, after the last byte.
+
+NOTE:  Assumes !CS is already low and the command/address are sent
+************************************************************************/
+static short	PumpReadBlock( uint8_t* data, long NumBytes )
+{
+	XferErr = MEMFALSE;
+	
+#if MEMXPORT == XPORT_HWSPI
+	uint8_t	in;
+	
+	if( NumBytes <= 0 )
+		return MEMSUCC;
+	
+	//	Start the next byte shifting as soon as the last one lands, and 
+	//		store while it goes - the bus never waits on the loop
+	SPDR = 0xFF;
+	while( --NumBytes > 0 )
+	{
+		while( !(SPSR & (1<<SPIF)) )
+			;
+		in = SPDR;
+		SPDR = 0xFF;
+		*data++ = in;
+	}
+	while( !(SPSR & (1<<SPIF)) )
+		;
+	*data = SPDR;
+	
+	return MEMSUCC;
+#else
+
+#if UNROLL_USED
+	while( NumBytes >= 4 )
+	{
+		data[0] = XferIn();
+		data[1] = XferIn();
+		data[2] = XferIn();
+		data[3] = XferIn();
+		data += 4;
+		NumBytes -= 4;
+	}
+#endif
+
+	while( NumBytes-- > 0 )
+		*data++ = XferIn();
+	
+	return XferErr ? MEMFAIL : MEMSUCC;
+#endif
+}
+
+short	PumpRead( uint8_t* data, long NumBytes )
+{
+	MEMSTAT( StatChip, bytesRead, NumBytes );
+	
+#if HOLD_USED
+	//	Give the bus up between blocks if somebody's asked for it
+	while( NumBytes > HOLD_CHUNK )
+	{
+		if( PumpReadBlock( data, HOLD_CHUNK ) )
+			return MEMFAIL;
+		
+		data += HOLD_CHUNK;
+		NumBytes -= HOLD_CHUNK;
+		
+		if( HoldWanted )
+			HoldYield();
+	}
+#endif
+	
+	return PumpReadBlock( data, NumBytes );
+}
+
+/************************************************************************
+Streams NumBytes in from the selected chip, comparing against data as 
+it goes.  Returns the offsets of the first and last mismatches (first 
+is -1 if everything matched).
+
+NOTE:  Assumes !CS is already low and the command/address are sent
+************************************************************************/
+short	PumpCompare( const uint8_t* data, short NumBytes, short* first, short* last )
+{
+	short	i;
+	
+	*first = -1;
+	*last = -1;
+	XferErr = MEMFALSE;
+	MEMSTAT( StatChip, bytesRead, NumBytes );
+	
+	for( i=0 ; i<NumBytes ; i++ )
+	{
+		if( XferIn() != data[i] )
+		{
+			if( *first < 0 )
+				*first = i;
+			*last = i;
+		}
+	}
+	
+	return XferErr ? MEMFAIL : MEMSUCC;
+}
+
+/************************************************************************
+Streaming CRC pumps:  PumpWriteCrc() is PumpWrite() with the CRC of the
+data folded into *crc;  PumpReadCrc() clocks NumBytes in and only keeps
+the CRC.
+
+NOTE:  Assume !CS is already low and the command/address are sent
+************************************************************************/
+short	PumpWriteCrc( const uint8_t* data, long NumBytes, uint16_t* crc )
+{
+	uint16_t	c = *crc;
+	
+	XferErr = MEMFALSE;
+	MEMSTAT( StatChip, bytesWritten, NumBytes );
+	
+	while( NumBytes-- > 0 )
+	{
+		XferOut( *data );
+		c = _crc_ccitt_update( c, *data++ );
+	}
+	
+	*crc = c;
+	
+	return XferErr ? MEMFAIL : MEMSUCC;
+}
+
+short	PumpReadCrc( long NumBytes, uint16_t* crc )
+{
+	uint16_t	c = *crc;
+	
+	XferErr = MEMFALSE;
+	MEMSTAT( StatChip, bytesRead, NumBytes );
+	
+	while( NumBytes-- > 0 )
+		c = _crc_ccitt_update( c, XferIn() );
+	
+	*crc = c;
+	
+	return XferErr ? MEMFAIL : MEMSUCC;
+}
+
+/************************************************************************
+Streams NumBytes out to the selected chip.  Errors are only checked 
+once, after the last byte.
+
+NOTE:  Assumes !CS is already low and the command/address are sent
+************************************************************************/
+short	PumpWrite( const uint8_t* data, long NumBytes )
+{
+	XferErr = MEMFALSE;
+	MEMSTAT( StatChip, bytesWritten, NumBytes );
+	
+#if MEMXPORT == XPORT_HWSPI
+	uint8_t	out;
+	
+	if( NumBytes <= 0 )
+		return MEMSUCC;
+	
+	//	Fetch the next byte while the current one shifts.  (SPDR can't be
+	//		written until the shift is done - that's a write collision.)
+	SPDR = *data++;
+	while( --NumBytes > 0 )
+	{
+		out = *data++;
+		while( !(SPSR & (1<<SPIF)) )
+			;
+		SPDR = out;
+	}
+	while( !(SPSR & (1<<SPIF)) )
+		;
+	(void)SPDR;						//	Clears SPIF
+	
+	return MEMSUCC;
+#else
+
+#if UNROLL_USED
+	while( NumBytes >= 4 )
+	{
+		XferOut( data[0] );
+		XferOut( data[1] );
+		XferOut( data[2] );
+		XferOut( data[3] );
+		data += 4;
+		NumBytes -= 4;
+	}
+#endif
+
+	while( NumBytes-- > 0 )
+		XferOut( *data++ );
+	
+	return XferErr ? MEMFAIL : MEMSUCC;
+#endif
+}
+
+
 /************************************************************************
 Read Sequence
 The device is selected by pulling CS low. The 8-bit
@@ -70,107 +478,742 @@ raising the CS pin (Figure 2-1).
 ************************************************************************/
 inline short	ReadData( short chip, long Address, long NumBytes, short* data )
 {
-	short	TData;			//	Temporary storage for data just read
-	
-	unsigned long	count;
+	MemPin	cs;				//	!CS pin, resolved once for the whole transfer
+	long	count;
 	
 	//	Send the command & address to the memory
-	if( SendCommandAndAddress( chip, MREAD, Address ) )
-		return MEMFAIL;
+	if( BeginCommand( chip, MREAD, &cs ) || SendAddress( chip, Address ) )
+	{
+		EndCommand( &cs );
+		return MEMFAILED( chip, STATF_READ );
+	}
 	
 	//  Command sent, now we need to read back what the chip sends us
+	XferErr = MEMFALSE;
+	MEMSTAT( chip, bytesRead, NumBytes );
+	
 	for( count=0 ; count<NumBytes ; count++ )
-	{
-		//	Read back the data
-		if( ReadByte( &TData ) )
-			return MEMFAIL;
-					
-		data[count] = TData;
-	}
+		data[count] = XferIn();
 
 	//  End read by setting CS high
-	if( SetCS( chip ) )
-		return MEMFAIL;
+	if( EndCommand( &cs ) || XferErr )
+		return MEMFAILED( chip, STATF_READ );
 
 	//  All done, let's get out of here!
 	return MEMSUCC;	
 }
 
+/************************************************************************
+Same as ReadData(), but into a byte buffer - one byte of RAM per byte 
+of EEPROM, so a whole page fits in PAGE_SIZE bytes.
+************************************************************************/
+short	ReadBytes( short chip, long Address, long NumBytes, uint8_t* data )
+{
+	MemPin	cs;				//	!CS pin, resolved once for the whole transfer
+	short	err;
+	
+	//	Send the command & address to the memory
+	if( BeginCommand( chip, MREAD, &cs ) || SendAddress( chip, Address ) )
+	{
+		EndCommand( &cs );
+		return MEMFAILED( chip, STATF_READ );
+	}
+	
+	err = PumpRead( data, NumBytes );
+	
+	//  End read by setting CS high
+	if( EndCommand( &cs ) )
+		return MEMFAILED( chip, STATF_READ );
+	
+	return err;
+}
 
 
-
-/*************************************************************************
-RELEASE FROM DEEP POWERDOWN AND READ ELECTRONIC SIGNATURE
-Once the device has entered Deep Power-Down
-mode all instructions are ignored except the release
-from Deep Power-down and Read Electronic Signature
-command. This command can also be used when
-the device is not in Deep Power-down, to read the
-electronic signature out on the SO pin unless another
-command is being executed such as Erase, Program
-or Write STATUS register.
-
-Release from Deep Power-Down mode and Read
-Electronic Signature is entered by driving CS low,
-followed by the RDID instruction code (Figure 2-12)
-and then a dummy address of 24 bits (A23-A0). After
-the last bit of the dummy address is clocked in, the
-8-bit Electronic signature is clocked out on the SO
-pin.
-
-After the signature has been read out at least once,
-the sequence can be terminated by driving CS high.
-The device will then return to Standby mode and will
-wait to be selected so it can be given new instructions.
-If additional clock cycles are sent after the electronic
-signature has been read once, it will continue to output
-the signature on the SO line until the sequence is
-terminated.
-*************************************************************************/
-short	WakeMem( short chip )
+/************************************************************************
+Write Sequence
+Prior to any attempt to write data to the 25AA1024, the
+write enable latch must be set by issuing the WREN
+instruction. This is done by setting CS low and then
+clocking out the proper instruction into the 25AA1024.
+After all eight bits of the instruction are transmitted, CS
+must be driven high to set the write enable latch.
+
+Once the write enable latch is set, the user may
+proceed by setting CS low, issuing a WRITE instruction,
+followed by the 24-bit address, with seven MSBs of the
+address being "don't care" bits, and then the data to be
+written. Up to 256 bytes of data can be sent to the
+device before a write cycle is necessary. The only
+restriction is that all of the bytes must reside in the
+same page.
+
+For the data to be actually written to the array,
+the CS must be brought high after the least significant
+bit (D0) of the nth data byte has been clocked in.  If
+CS is brought high at any other time, the write operation
+will not be completed.
+
+So: the range is chopped up at page boundaries, and each
+piece gets one WREN + WRITE + address, the whole piece
+streamed out, and one burn cycle.  A full page costs the
+same 6ms as a single byte.
+************************************************************************/
+short	WriteData( short chip, long Address, long NumBytes, short* data )
 {
-	short	TData;
+	long	count;			//	Bytes written so far
+	long	chunk;			//	Bytes going into the current page
+	long	i;
 	
-	//	Send Wake Up
-	//	Send the command & address to the memory
-	if( SendCommandAndAddress( chip, MRDID, (long)0x00A5A5A5 ) )
-		return MEMFAIL;
+	if( CheckRange( Address, NumBytes ) )
+		return MEMFAILED( chip, STATF_WRITE );
 	
-	//	Read back the device ID	
-	if( ReadByte( &TData ) )
-		return MEMFAIL;
+	for( count=0 ; count<NumBytes ; count+=chunk )
+	{
+		//	Don't run past the end of this page, or we wrap around inside it
+		chunk = PageRemain( Address + count );
+		if( chunk > (NumBytes - count) )
+			chunk = NumBytes - count;
 		
-	//  Set !CS high
-	if( SetCS( chip ) )
-		return MEMFAIL;
+		//	WREN, then WRITE + address (leaves !CS low)
+		if( BeginPageWrite( chip, Address + count ) )
+			return MEMFAILED( chip, STATF_WRITE );
+		
+		//	Stream the whole chunk out - errors checked once, at the end
+		XferErr = MEMFALSE;
+		MEMSTAT( chip, bytesWritten, chunk );
+		
+		for( i=0 ; i<chunk ; i++ )
+			XferOut( (uint8_t)data[count + i] );
+		
+		//	Raise !CS to start the burn
+		if( EndPageWrite( chip ) || XferErr )
+			return MEMFAILED( chip, STATF_WRITE );
+		
+		//	Returns as soon as WIP clears - usually well under MTWC
+		if( WaitWriteComplete( chip, MTWC ) )
+			return MEMFAILED( chip, STATF_WRITE );
+	}
 	
-	//	Check device ID against Device ID
-	if( TData != MDEVICE )
-		return MEMFAIL;
+	return MEMSUCC;
+}
+
+/************************************************************************
+Same as WriteData(), but from a byte buffer.  Same page splitting.
+************************************************************************/
+short	WriteBytes( short chip, long Address, long NumBytes, const uint8_t* data )
+{
+	long	count;			//	Bytes written so far
+	long	chunk;			//	Bytes going into the current page
+	
+	if( CheckRange( Address, NumBytes ) )
+		return MEMFAILED( chip, STATF_WRITE );
+	
+	for( count=0 ; count<NumBytes ; count+=chunk )
+	{
+		chunk = PageRemain( Address + count );
+		if( chunk > (NumBytes - count) )
+			chunk = NumBytes - count;
 		
+		if( WritePage( chip, Address + count, chunk, &data[count] ) )
+			return MEMFAILED( chip, STATF_WRITE );
+		
+		if( WaitWriteComplete( chip, MTWC ) )
+			return MEMFAILED( chip, STATF_WRITE );
+	}
+	
 	return MEMSUCC;
 }
 
-/*************************************************************************
-DEEP POWER-DOWN MODE
+/************************************************************************
+Like WriteBytes(), but only programs what actually changed.
 
-Deep Power-Down mode of the 25AA1024 is its
-lowest power consumption state. The device will not
-respond to any of the Read or Write commands while
-in Deep Power-Down mode, and therefore it can be
-used as an additional software write protection feature.
-The Deep Power-Down mode is entered by driving CS
-low, followed by the instruction code (Figure 2-11) onto
-the SI line, followed by driving CS high.
-If the CS pin is not driven high after the eighth bit of the
-instruction code has been given, the device will not
-execute Deep power-down. Once the CS line is driven
-high, there is a delay (TDP) before the current settles
-to its lowest consumption.
+Each page's worth of the range is read back first (at SCK speed) and 
+compared against data on the fly - no buffer.  If nothing differs the 
+page is skipped entirely;  otherwise only the span from the first to 
+the last differing byte is programmed.  One write cycle costs the same
+whatever its length, so one span per page is as cheap as it gets.
 
-All instructions given during Deep Power-Down mode
-are ignored except the Read Electronic Signature
-Command (RDID). The RDID command will release
+Inputs:
+	same as WriteBytes()
+	short* programmed	- (may be 0) number of page programs issued
+************************************************************************/
+short	WriteDataIfChanged( short chip, long Address, long NumBytes, const uint8_t* data, short* programmed )
+{
+	long	count;
+	long	chunk;
+	short	first;			//	First differing byte in this chunk (-1 = none)
+	short	last;			//	Last differing byte in this chunk
+	MemPin	cs;
+	short	err;
+	
+	if( programmed )
+		*programmed = 0;
+	
+	if( CheckRange( Address, NumBytes ) )
+		return MEMFAILED( chip, STATF_WRITE );
+	
+	for( count=0 ; count<NumBytes ; count+=chunk )
+	{
+		chunk = PageRemain( Address + count );
+		if( chunk > (NumBytes - count) )
+			chunk = NumBytes - count;
+		
+		//	Previous program (if any) has to be done before we can read
+		if( WaitWriteComplete( chip, MTWC ) )
+			return MEMFAILED( chip, STATF_WRITE );
+		
+		if( BeginCommand( chip, MREAD, &cs ) || SendAddress( chip, Address + count ) )
+		{
+			EndCommand( &cs );
+			return MEMFAILED( chip, STATF_WRITE );
+		}
+		
+		err = PumpCompare( &data[count], (short)chunk, &first, &last );
+		
+		if( EndCommand( &cs ) || err )
+			return MEMFAILED( chip, STATF_READ );
+		
+		if( first < 0 )
+			continue;			//	Already there
+		
+		if( WritePage( chip, Address + count + first, last - first + 1, &data[count + first] ) )
+			return MEMFAILED( chip, STATF_WRITE );
+		
+		if( programmed )
+			(*programmed)++;
+	}
+	
+	return WaitWriteComplete( chip, MTWC );
+}
+
+/************************************************************************
+Like WriteBytes(), but verified.
+
+A CRC-16 (CCITT, the avr-libc flavour) is run over the data as it is 
+streamed out, then the whole range is read back once after the last
+write cycle, CRC'ing on the fly again.  Nothing is buffered, so it 
+costs one extra read pass and two bytes of RAM.
+
+Returns
+	MEMSUCC	- written and verified
+	MEMFAIL	- write failed, or the readback didn't match
+************************************************************************/
+short	WriteBytesVerify( short chip, long Address, long NumBytes, const uint8_t* data )
+{
+	long		count;
+	long		chunk;
+	uint16_t	sent = MEMCRC_INIT;		//	CRC of what went out
+	uint16_t	got;					//	CRC of what came back
+	
+	if( CheckRange( Address, NumBytes ) )
+		return MEMFAILED( chip, STATF_WRITE );
+	
+	for( count=0 ; count<NumBytes ; count+=chunk )
+	{
+		chunk = PageRemain( Address + count );
+		if( chunk > (NumBytes - count) )
+			chunk = NumBytes - count;
+		
+		if( BeginPageWrite( chip, Address + count ) )
+			return MEMFAILED( chip, STATF_WRITE );
+		
+		if( PumpWriteCrc( &data[count], chunk, &sent ) )
+		{
+			SetCS( chip );
+			return MEMFAILED( chip, STATF_WRITE );
+		}
+		
+		if( EndPageWrite( chip ) || WaitWriteComplete( chip, MTWC ) )
+			return MEMFAILED( chip, STATF_WRITE );
+	}
+	
+	if( CrcData( chip, Address, NumBytes, &got ) )
+		return MEMFAILED( chip, STATF_WRITE );
+	
+	if( got != sent )
+		return MEMFAILED( chip, STATF_WRITE );
+	
+	return MEMSUCC;
+}
+
+/************************************************************************
+Computes the CRC-16 of [Address, Address+NumBytes) in one READ, without 
+buffering anything.  Starts from MEMCRC_INIT.
+************************************************************************/
+short	CrcData( short chip, long Address, long NumBytes, uint16_t* crc )
+{
+	MemPin	cs;
+	short	err;
+	
+	*crc = MEMCRC_INIT;
+	
+	if( BeginCommand( chip, MREAD, &cs ) || SendAddress( chip, Address ) )
+	{
+		EndCommand( &cs );
+		return MEMFAILED( chip, STATF_READ );
+	}
+	
+	err = PumpReadCrc( NumBytes, crc );
+	
+	if( EndCommand( &cs ) || err )
+		return MEMFAILED( chip, STATF_READ );
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Streams [Address, Address+NumBytes) to a callback, one byte at a time, 
+inside a single READ - no buffer at all, so any length goes in constant
+RAM (e.g. straight into a UART).
+
+Inputs:
+	short chip	 - the chip to be read
+	long Address - the first address to be read
+	long NumBytes - how many
+	MemSink sink	- gets each byte;  anything but MEMSUCC stops the read
+	void* ctx	 - passed to sink
+	
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure, or if sink stopped it
+	
+NOTE:  !CS stays low while sink runs, so everything else on the bus 
+	waits for it.
+*************************************************************************/
+short	ReadDataStream( short chip, long Address, long NumBytes, MemSink sink, void* ctx )
+{
+	MemPin	cs;
+	long	count;
+	
+	if( CheckRange( Address, NumBytes ) )
+		return MEMFAILED( chip, STATF_READ );
+	
+	if( BeginCommand( chip, MREAD, &cs ) || SendAddress( chip, Address ) )
+	{
+		EndCommand( &cs );
+		return MEMFAILED( chip, STATF_READ );
+	}
+	
+	XferErr = MEMFALSE;
+	MEMSTAT( chip, bytesRead, NumBytes );
+	
+	for( count=0 ; count<NumBytes ; count++ )
+	{
+		if( sink( ctx, XferIn() ) != MEMSUCC )
+			break;
+		
+#if HOLD_USED
+		if( HoldWanted )
+			HoldYield();
+#endif
+	}
+	
+	if( EndCommand( &cs ) || XferErr || (count < NumBytes) )
+		return MEMFAILED( chip, STATF_READ );
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Writes [Address, Address+NumBytes) from a callback.  Same page splitting
+as WriteBytes():  one WRITE per page, with the bytes pulled from source
+while !CS is low, then a wait for the write cycle.
+
+Inputs:
+	short chip	 - the chip to be written
+	long Address - the first address to be written
+	long NumBytes - how many
+	MemSource source	- hands over each byte;  anything but MEMSUCC stops
+	void* ctx	 - passed to source
+	
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure, or if source stopped it.  What it handed over
+		before it stopped HAS been written.
+*************************************************************************/
+short	WriteDataStream( short chip, long Address, long NumBytes, MemSource source, void* ctx )
+{
+	long	count;			//	Bytes written so far
+	long	chunk;			//	Bytes going into the current page
+	long	i;
+	uint8_t	byte;
+	short	stop = MEMFALSE;
+	
+	if( CheckRange( Address, NumBytes ) )
+		return MEMFAILED( chip, STATF_WRITE );
+	
+	for( count=0 ; (count<NumBytes) && !stop ; count+=chunk )
+	{
+		chunk = PageRemain( Address + count );
+		if( chunk > (NumBytes - count) )
+			chunk = NumBytes - count;
+		
+		//	Get the first byte before starting the WRITE - an empty WRITE
+		//		would still cost a write cycle
+		if( source( ctx, &byte ) != MEMSUCC )
+			return MEMFAILED( chip, STATF_WRITE );
+		
+		if( BeginPageWrite( chip, Address + count ) )
+			return MEMFAILED( chip, STATF_WRITE );
+		
+		XferErr = MEMFALSE;
+		XferOut( byte );
+		
+		for( i=1 ; i<chunk ; i++ )
+		{
+			if( source( ctx, &byte ) != MEMSUCC )
+			{
+				stop = MEMTRUE;
+				break;
+			}
+			XferOut( byte );
+		}
+		MEMSTAT( chip, bytesWritten, i );
+		
+		if( EndPageWrite( chip ) || XferErr )
+			return MEMFAILED( chip, STATF_WRITE );
+		
+		if( WaitWriteComplete( chip, MTWC ) )
+			return MEMFAILED( chip, STATF_WRITE );
+	}
+	
+	return stop ? MEMFAILED( chip, STATF_WRITE ) : MEMSUCC;
+}
+
+/*************************************************************************
+Scatter-gather:  [Address, ...) read into / written from a list of 
+pieces as if they were one buffer - e.g. a header struct, a payload and
+a CRC - without gluing them together in RAM first.  Reads are a single
+READ;  writes get the same page splitting as WriteBytes(), with pages 
+and pieces cut wherever they fall.
+
+Inputs:
+	short chip	 - the chip
+	long Address - the first address
+	vec			 - the pieces, in order (MemConstVec for writes, so 
+					const data goes in without a cast)
+	short count	 - how many pieces
+	
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure
+*************************************************************************/
+short	ReadDataV( short chip, long Address, const MemVec* vec, short count )
+{
+	MemPin	cs;
+	long	total;
+	short	err = MEMSUCC;
+	short	i;
+	
+	for( total=0, i=0 ; i<count ; i++ )
+		total += vec[i].len;
+	
+	if( CheckRange( Address, total ) )
+		return MEMFAILED( chip, STATF_READ );
+	
+	if( BeginCommand( chip, MREAD, &cs ) || SendAddress( chip, Address ) )
+	{
+		EndCommand( &cs );
+		return MEMFAILED( chip, STATF_READ );
+	}
+	
+	for( i=0 ; (i < count) && !err ; i++ )
+		err = PumpRead( (uint8_t*)vec[i].ptr, vec[i].len );
+	
+	if( EndCommand( &cs ) || err )
+		return MEMFAILED( chip, STATF_READ );
+	
+	return MEMSUCC;
+}
+
+short	WriteDataV( short chip, long Address, const MemConstVec* vec, short count )
+{
+	long		total;
+	long		room;			//	Left in the current page
+	uint16_t	off = 0;		//	Offset into vec[i]
+	uint16_t	n;
+	short		i;
+	
+	for( total=0, i=0 ; i<count ; i++ )
+		total += vec[i].len;
+	
+	if( CheckRange( Address, total ) )
+		return MEMFAILED( chip, STATF_WRITE );
+	
+	i = 0;	
+	while( total > 0 )
+	{
+		room = PageRemain( Address );
+		if( room > total )
+			room = total;
+		
+		if( BeginPageWrite( chip, Address ) )
+			return MEMFAILED( chip, STATF_WRITE );
+		
+		Address += room;
+		total -= room;
+		
+		//	Fill the page from as many pieces as it takes
+		while( room > 0 )
+		{
+			n = vec[i].len - off;
+			if( n > room )
+				n = (uint16_t)room;
+			
+			if( PumpWrite( (const uint8_t*)vec[i].ptr + off, n ) )
+			{
+				EndPageWrite( chip );
+				return MEMFAILED( chip, STATF_WRITE );
+			}
+			
+			room -= n;
+			off += n;
+			if( off >= vec[i].len )
+			{
+				i++;
+				off = 0;
+			}
+		}
+		
+		if( EndPageWrite( chip ) || WaitWriteComplete( chip, MTWC ) )
+			return MEMFAILED( chip, STATF_WRITE );
+	}
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Writes up to one page worth of data, starting at Address.  Does NOT wait
+for the write cycle to finish - check IsBusy()/WaitWriteComplete() before
+talking to this chip again.
+
+Inputs:
+	short chip	 - the chip to be written
+	long Address - the first address to be written
+	short NumBytes	- bytes to write.  Address + NumBytes must not cross
+				a page boundary (they'd wrap around inside the page)
+	const uint8_t* data	- the data
+	
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure
+*************************************************************************/
+short	WritePage( short chip, long Address, short NumBytes, const uint8_t* data )
+{
+	if( NumBytes > PageRemain( Address ) )
+		return MEMFAILED( chip, STATF_WRITE );
+	
+	if( BeginPageWrite( chip, Address ) )
+		return MEMFAILED( chip, STATF_WRITE );
+	
+	if( PumpWrite( data, NumBytes ) )
+	{
+		SetCS( chip );
+		return MEMFAILED( chip, STATF_WRITE );
+	}
+	
+	return EndPageWrite( chip );
+}
+
+/*************************************************************************
+Starts a page write:  sets the write enable latch, then sends the WRITE
+command and address.
+
+Inputs:
+	short chip	 - the chip to be written
+	long Address - the first address to be written
+	
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure
+	
+NOTE:  Leaves !CS set low on exit.  Everything sent from here up to
+		EndPageWrite() has to land in the same page as Address.
+*************************************************************************/
+short	BeginPageWrite( short chip, long Address )
+{
+	if( WriteEnable( chip ) )
+		return MEMFAILED( chip, STATF_WRITE );
+	
+	if( SendCommandAndAddress( chip, MWRITE, Address ) )
+	{
+		SetCS( chip );
+		return MEMFAILED( chip, STATF_WRITE );
+	}
+	
+#if PAGEMAP_USED
+	MapWritten( chip, Address );
+#endif
+#if WEAR_USED
+	WearProgrammed( chip, Address );
+#endif
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Ends a page write by raising !CS, which kicks off the internal write
+cycle.  Does NOT wait for the write cycle to finish.
+
+Inputs:
+	short chip	 - the chip being written
+	
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure
+*************************************************************************/
+short	EndPageWrite( short chip )
+{
+	return SetCS( chip );
+}
+
+/*************************************************************************
+Write Enable (WREN) and Write Disable (WRDI)
+The 25AA1024 contains a write enable latch. See Table
+2-4 for the Write-Protect Functionality Matrix. This latch
+must be set before any write operation will be completed
+internally. The WREN instruction will set the latch, and
+the WRDI will reset the latch.
+
+The following is a list of conditions under which the
+write enable latch will be reset:
+- Power-up
+- WRDI instruction successfully executed
+- WRSR instruction successfully executed
+- WRITE instruction successfully executed
+- PE instruction successfully executed
+- SE instruction successfully executed
+- CE instruction successfully executed
+
+The latch is only set/reset once !CS goes high, so these leave 
+!CS high on exit.
+*************************************************************************/
+short	WriteEnable( short chip )
+{
+	if( SendCommand( chip, MWREN ) )
+	{
+		SetCS( chip );
+		return MEMFAIL;
+	}
+	
+	if( SetCS( chip ) )
+		return MEMFAIL;
+	
+	return MEMSUCC;
+}
+
+short	WriteDisable( short chip )
+{
+	if( SendCommand( chip, MWRDI ) )
+	{
+		SetCS( chip );
+		return MEMFAIL;
+	}
+	
+	if( SetCS( chip ) )
+		return MEMFAIL;
+	
+	return MEMSUCC;
+}
+
+
+
+
+/*************************************************************************
+RELEASE FROM DEEP POWERDOWN AND READ ELECTRONIC SIGNATURE
+Once the device has entered Deep Power-Down
+mode all instructions are ignored except the release
+from Deep Power-down and Read Electronic Signature
+command. This command can also be used when
+the device is not in Deep Power-down, to read the
+electronic signature out on the SO pin unless another
+command is being executed such as Erase, Program
+or Write STATUS register.
+
+Release from Deep Power-Down mode and Read
+Electronic Signature is entered by driving CS low,
+followed by the RDID instruction code (Figure 2-12)
+and then a dummy address of 24 bits (A23-A0). After
+the last bit of the dummy address is clocked in, the
+8-bit Electronic signature is clocked out on the SO
+pin.
+
+After the signature has been read out at least once,
+the sequence can be terminated by driving CS high.
+The device will then return to Standby mode and will
+wait to be selected so it can be given new instructions.
+If additional clock cycles are sent after the electronic
+signature has been read once, it will continue to output
+the signature on the SO line until the sequence is
+terminated.
+*************************************************************************/
+short	WakeMem( short chip )
+{
+	short	TData;
+	
+	//	Send Wake Up
+	//	Send the command & address to the memory
+	if( SendCommandAndAddress( chip, MRDID, (long)0x00A5A5A5 ) )
+		return MEMFAILED( chip, STATF_POWER );
+	
+	//	Read back the device ID	
+	if( ReadByte( &TData ) )
+		return MEMFAILED( chip, STATF_POWER );
+		
+	//  Set !CS high
+	if( SetCS( chip ) )
+		return MEMFAILED( chip, STATF_POWER );
+	
+	//	Check device ID against Device ID
+	if( TData != MDEVICE )
+		return MEMFAILED( chip, STATF_POWER );
+		
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Fast wake:  just the RDID instruction, no dummy address and no signature
+read/compare, then the TREL wait the datasheet asks for before the next
+command.  Use WakeMem() when you actually want to know it's there.
+*************************************************************************/
+short	WakeMemFast( short chip )
+{
+	MemPin	cs;
+	
+	if( BeginCommand( chip, MRDID, &cs ) )
+	{
+		EndCommand( &cs );
+		return MEMFAILED( chip, STATF_POWER );
+	}
+	
+	if( EndCommand( &cs ) )
+		return MEMFAILED( chip, STATF_POWER );
+	
+	_delay_us( MTREL_US );
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+DEEP POWER-DOWN MODE
+
+Deep Power-Down mode of the 25AA1024 is its
+lowest power consumption state. The device will not
+respond to any of the Read or Write commands while
+in Deep Power-Down mode, and therefore it can be
+used as an additional software write protection feature.
+The Deep Power-Down mode is entered by driving CS
+low, followed by the instruction code (Figure 2-11) onto
+the SI line, followed by driving CS high.
+If the CS pin is not driven high after the eighth bit of the
+instruction code has been given, the device will not
+execute Deep power-down. Once the CS line is driven
+high, there is a delay (TDP) before the current settles
+to its lowest consumption.
+
+All instructions given during Deep Power-Down mode
+are ignored except the Read Electronic Signature
+Command (RDID). The RDID command will release
 the device from Deep power-down and outputs the
 electronic signature on the SO pin, and then returns
 the device to Standby mode after delay (TREL)
@@ -178,588 +1221,1696 @@ Deep Power-Down mode automatically releases at
 device power-down. Once power is restored to the
 device, it will power-up in the Standby mode.
 *************************************************************************/
-short	SleepMem( short chip )
+short	SleepMem( short chip )
+{
+#if CACHE_PAGES
+	//	Anything still sitting in RAM has to go out first
+	if( CacheFlush( chip ) )
+		return MEMFAILED( chip, STATF_POWER );
+#endif
+
+	//	Only do this if defined
+	if( WP_USED )
+		if( ClearWP( chip ) )
+			return MEMFAILED( chip, STATF_POWER );
+		
+	//	Set !CS low to talk
+	if( ClearCS( chip ) )
+		return MEMFAILED( chip, STATF_POWER );
+	
+	//	Send Power Down command
+	if( SendCommand( chip, MDPD ) )
+		return MEMFAILED( chip, STATF_POWER );
+	
+	//	Command successfully sent - set !CS high
+	if( SetCS( chip ) )
+		return MEMFAILED( chip, STATF_POWER );
+	
+#if AUTOSLEEP_USED
+	if( chip < NUM_CHIPS )
+		PowerAsleep[chip] = MEMTRUE;
+#endif
+	
+	//	Welp.  Chip is asleep.  Time to go home.
+	return MEMSUCC;
+}
+
+#if AUTOSLEEP_USED
+/*************************************************************************
+Automatic deep power-down
+
+Call PowerTick() every so often from the main loop with the number of
+ms since the last call.  Any chip that hasn't seen a command for 
+SLEEP_AFTER ms is put into deep power-down.
+
+NOTE:  Main loop only - not from a timer ISR.  It sends commands, which
+	would land in the middle of whatever transaction the ISR cut into.
+	As a backstop it only counts time (sends nothing) while any !CS is
+	low or an async transfer is running - which includes an open 
+	MemReader, so close readers to let the chips sleep.
+
+Nothing else changes for the caller:  the first command sent to a 
+sleeping chip (BeginCommand() / MemSubmit()) wakes it up first.  With 
+FASTWAKE_USED that's WakeMemFast() - RDID and the TREL wait, about 
+100us - instead of the full WakeMem() signature check.
+*************************************************************************/
+void	PowerTick( unsigned short ms )
+{
+	MemPin	cs;
+	uint8_t	open = MEMFALSE;		//	A transaction is under way somewhere
+	short	chip;
+	
+#if ASYNC_USED
+	if( AsyncBusy() )
+		open = MEMTRUE;
+#endif
+	for( chip=0 ; chip<NUM_CHIPS ; chip++ )
+	{
+		cs = CSPin( chip );
+		if( !(*cs.pin & cs.mask) )
+			open = MEMTRUE;
+	}
+	
+	for( chip=0 ; chip<NUM_CHIPS ; chip++ )
+	{
+		if( PowerAsleep[chip] )
+			continue;
+		
+		//	In long - SLEEP_AFTER - ms goes negative (wraps) on a long tick
+		if( ((unsigned long)PowerIdle[chip] + ms) < SLEEP_AFTER )
+		{
+			PowerIdle[chip] += ms;
+			continue;
+		}
+		
+		PowerIdle[chip] = SLEEP_AFTER;
+		
+		if( open )
+			continue;
+		
+		//	Don't pull the plug in the middle of a write cycle (this 
+		//		counts as activity, so it'll be looked at again later)
+		if( IsBusy( chip ) != MEMFALSE )
+			continue;
+		
+		SleepMem( chip );
+	}
+}
+
+/*************************************************************************
+Wakes the chip if the power manager put it to sleep, and restarts its
+idle timer either way
+*************************************************************************/
+short	PowerWake( short chip )
+{
+	if( (chip < 0) || (chip >= NUM_CHIPS) )
+		return MEMSUCC;
+	
+	PowerIdle[chip] = 0;
+	
+	if( !PowerAsleep[chip] )
+		return MEMSUCC;
+	
+	//	Clear it first - the wake-up goes through BeginCommand() too
+	PowerAsleep[chip] = MEMFALSE;
+	
+#if FASTWAKE_USED
+	if( WakeMemFast( chip ) )
+#else
+	if( WakeMem( chip ) )
+#endif
+	{
+		PowerAsleep[chip] = MEMTRUE;
+		return MEMFAIL;
+	}
+	
+	return MEMSUCC;
+}
+#endif
+
+/*************************************************************************
+Read Status Register Instruction
+(RDSR)
+The Read Status Register instruction (RDSR) provides
+access to the STATUS register. The STATUS register
+may be read at any time, even during a write cycle. The
+STATUS register is formatted as follows:
+TABLE 2-2: STATUS REGISTER
+
+The Write-In-Process (WIP) bit indicates whether the
+25AA1024 is busy with a write operation. When set to
+a 1, a write is in progress, when set to a 0, no write
+is in progress. This bit is read-only.
+
+The Write Enable Latch (WEL) bit indicates the status
+of the write enable latch and is read-only. When set to
+a 1, the latch allows writes to the array, when set to a
+0, the latch prohibits writes to the array. The state of
+this bit can always be updated via the WREN or WRDI
+commands regardless of the state of write protection
+on the STATUS register. These commands are shown
+in Figure 2-4 and Figure 2-5.
+
+The Block Protection (BP0 and BP1) bits indicate
+which blocks are currently write-protected. These bits
+are set by the user issuing the WRSR instruction. These
+bits are nonvolatile and are shown in Table 2-3.
+See Figure 2-6 for the RDSR timing sequence.
+
+NOTE:  Raises !CS on exit, so this can be called back-to-back (e.g. 
+		polling WIP) without confusing the memory
+*************************************************************************/
+short	ReadMemStatus( short chip, short* status )
+{
+	short	temp;
+	
+	//  Read the status register to ensure the WREN bit was set (or BP bits, etc)
+	//	Send the command to read the status register
+	if( SendCommand( chip, MRDSR ) )
+		return MEMFAILED( chip, STATF_STATUS );
+		
+	//	Read back the data
+	if( ReadByte( &temp ) )
+	{
+		SetCS( chip );
+		return MEMFAILED( chip, STATF_STATUS );
+	}
+	
+	//	Done with this transaction
+	if( SetCS( chip ) )
+		return MEMFAILED( chip, STATF_STATUS );
+	
+	*status = temp;
+	
+	return MEMSUCC;		
+}
+
+/*************************************************************************
+Write Status Register Instruction
+(WRSR)
+The Write Status Register instruction (WRSR) allows the
+user to write to the nonvolatile bits in the STATUS
+register as shown in Table 2-2. The user is able to
+select one of four levels of protection for the array by
+writing to the appropriate bits in the STATUS register.
+The array is divided up into four segments. The user
+has the ability to write-protect none, one, two, or all four
+of the segments of the array. The partitioning is
+controlled as shown in Table 2-3.
+
+The Write-Protect Enable (WPEN) bit is a nonvolatile
+bit that is available as an enable bit for the WP pin. The
+Write-Protect (WP) pin and the Write-Protect Enable
+(WPEN) bit in the STATUS register control the
+programmable hardware write-protect feature. Hardware
+write protection is enabled when WP pin is low
+and the WPEN bit is high. Hardware write protection is
+disabled when either the WP pin is high or the WPEN
+bit is low. When the chip is hardware write-protected,
+only writes to nonvolatile bits in the STATUS register
+are disabled. See Table 2-4 for a matrix of functionality
+on the WPEN bit.
+
+See Figure 2-7 for the WRSR timing sequence
+
+Get that!?  Gotta set the WPEN bit to write protect the memory!
+*************************************************************************/
+short	WriteMemStatus( short chip, short* status )
+{
+	short	temp;
+	short	new_status;
+	
+	temp = *status;
+	
+	//  De-assert the !WP pin
+	if( SetWP( chip ) )
+		return MEMFAILED( chip, STATF_STATUS );
+	
+	//	WRSR needs the write enable latch set, same as any other write
+	if( WriteEnable( chip ) )
+		return MEMFAILED( chip, STATF_STATUS );
+	
+	//	Send the command to write the status register
+	if( SendCommand( chip, MWRSR ) )
+		return MEMFAILED( chip, STATF_STATUS );
+		
+	//	Send the status byte
+	if( SendByte( temp ) )
+	{
+		SetCS( chip );
+		return MEMFAILED( chip, STATF_STATUS );
+	}
+	
+	//	!CS high starts the (nonvolatile) write cycle
+	if( SetCS( chip ) )
+		return MEMFAILED( chip, STATF_STATUS );
+	
+	if( WaitWriteComplete( chip, MTWC ) )
+		return MEMFAILED( chip, STATF_STATUS );
+
+	//  Re-assert the !WP pin
+	if( ClearWP( chip ) )
+		return MEMFAILED( chip, STATF_STATUS );
+	
+	//  Read back the status for verification
+	if( ReadMemStatus( chip, &new_status) )
+		return MEMFAILED( chip, STATF_STATUS );
+		
+	if( (temp & 0x8C) != (new_status & 0x8C) )
+		return MEMFAILED( chip, STATF_STATUS );
+		
+	return MEMSUCC;		
+}
+
+
+/*************************************************************************
+based on the input chip number, returns the appropriate CS for control
+input:
+	short	chip (0-4)
+returns:
+	short	CS
+*************************************************************************/
+inline short	GetCS( short chip )
+{
+	switch( chip )
+	{
+		case 0: return CS0;
+		case 1: return CS1;
+		case 2:	return CS2;
+		case 3: return CS3;
+		default: return CS0;
+	}
+	
+	return CS0;
+}
+
+/*************************************************************************
+based on the input chip number, returns the appropriate WP for control
+input:
+	short	chip (0-4)
+returns:
+	short	WP
+*************************************************************************/
+short	GetWP( short chip )
+{
+	switch( chip )
+	{
+		case 0: return WP0;
+		case 1: return WP1;
+		case 2:	return WP2;
+		case 3: return WP3;
+		default: return WP0;
+	}
+	
+	return WP0;
+}
+
+/*************************************************************************
+Initializes the selected memory (sets control inputs to known values)
+	Also "wakes" memory
+input:
+	short	chip (0-4)
+Affects:
+	Appropriate CS line (low)
+	Appropriate WP line (hi)
+*************************************************************************/
+short	InitMem( short chip )
+{
+	MemPin	cs;
+	MemPin	wp;
+	
+	if( (chip < 0) || (chip > 3) )
+		return MEMFAIL;
+	
+	cs = CSPin( chip );
+	wp = WPPin( chip );
+	
+	*cs.ddr |= cs.mask;
+	*wp.ddr |= wp.mask;
+	
+#if HOLD_USED
+	//	!HOLD high = not holding
+	HOLDPort |= (1<<HOLD);
+	HOLDDDR |= (1<<HOLD);
+#endif
+	
+	XportInit();
+/*	
+	//	Wake the memory
+	if( WakeMem( chip ) )
+		return MEMFAIL;
+*/		
+	//  Set !WP low (if used)
+	if( WP_USED )
+		if( ClearWP( chip ) )	
+			return MEMFAIL;
+	
+#if SCKCAL_USED
+	//	Failing that, the chip's left at the slowest rate - still usable
+	(void)CalibrateSck( chip );
+#endif
+			
+	return MEMSUCC;
+}
+
+#if SCKCAL_USED
+#if MEMXPORT != XPORT_HWSPI
+#error "SCKCAL_USED needs MEMXPORT to be XPORT_HWSPI"
+#endif
+#ifndef SCKCAL_ADDR
+#error "SCKCAL_USED needs SCKCAL_ADDR (see 25AA1024.h)"
+#endif
+
+//	Plenty of edges, and every bit both ways
+static const uint8_t	SckPattern[SCKCAL_LEN] = 
+{
+	0x55, 0xAA, 0x00, 0xFF, 0x0F, 0xF0, 0x33, 0xCC,
+	0x01, 0x80, 0xFE, 0x7F, 0x96, 0x69, 0xA5, 0x5A
+};
+
+//	SCKCAL_TRIES rounds of signature + pattern at the chip's current rate
+static short	SckTest( short chip )
+{
+	uint8_t	buf[SCKCAL_LEN];
+	short	i;
+	
+	for( i=0 ; i<SCKCAL_TRIES ; i++ )
+	{
+		if( WakeMem( chip ) )
+			return MEMFAIL;
+		
+		if( ReadBytes( chip, SCKCAL_ADDR, SCKCAL_LEN, buf ) ||
+			memcmp( buf, SckPattern, SCKCAL_LEN ) )
+			return MEMFAIL;
+	}
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Finds the fastest SCK a chip works at.  The test pattern is checked (and
+written, the first time) at the slowest rate, then each rate from 
+F_CPU/2 down has to read the signature and the pattern back 
+SCKCAL_TRIES times in a row.  The first one that does (less 
+SCKCAL_MARGIN) is used for the chip from then on.  Called by InitMem(),
+which carries on at the slowest rate if this fails.
+
+Inputs:
+	short chip	 - the chip
+	
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- the chip doesn't work even at F_CPU/128, or the pattern 
+		couldn't be written;  either way it's left at F_CPU/128
+	
+NOTE:  SCKCAL_ADDR is written on a fresh chip, so it must be kept for 
+	this alone, and out of any block protected part (or program the 
+	pattern there beforehand).
+NOTE:  A marginal rate can pass and still fail now and then (hot, low 
+	supply...) - that's what SCKCAL_MARGIN is for.
+*************************************************************************/
+short	CalibrateSck( short chip )
+{
+	uint8_t	buf[SCKCAL_LEN];
+	short	r;
+	
+	if( (chip < 0) || (chip >= NUM_CHIPS) )
+		return MEMFAIL;
+	
+	SckRate[chip] = SCK_RATES - 1;
+	
+	if( WakeMem( chip ) || ReadBytes( chip, SCKCAL_ADDR, SCKCAL_LEN, buf ) )
+		return MEMFAIL;
+	
+	if( memcmp( buf, SckPattern, SCKCAL_LEN ) )
+		if( WriteBytes( chip, SCKCAL_ADDR, SCKCAL_LEN, SckPattern ) || SckTest( chip ) )
+			return MEMFAIL;
+	
+	for( r=0 ; r<SCK_RATES ; r++ )
+	{
+		SckRate[chip] = r;
+		if( SckTest( chip ) == MEMSUCC )
+			break;
+	}
+	
+	if( r >= SCK_RATES )
+	{
+		SckRate[chip] = SCK_RATES - 1;
+		return MEMFAIL;
+	}
+	
+	r += SCKCAL_MARGIN;
+	SckRate[chip] = (r < SCK_RATES) ? r : SCK_RATES - 1;
+	
+	return MEMSUCC;
+}
+#endif
+
+/*************************************************************************
+Returns the chip's SCK divider (SCK = F_CPU / divider), or 0 if the 
+transport doesn't have one
+*************************************************************************/
+short	GetSckDivider( short chip )
+{
+#if MEMXPORT == XPORT_HWSPI
+#if SCKCAL_USED
+	if( (chip >= 0) && (chip < NUM_CHIPS) )
+		return 2 << SckRate[chip];
+#endif
+	(void)chip;
+	return 2;
+#else
+	(void)chip;
+	return 0;
+#endif
+}
+
+void CloseMem( short chip )
+{
+	MemPin	cs;
+	MemPin	wp;
+	
+	if( (chip < 0) || (chip > 3) )
+		return;
+	
+	cs = CSPin( chip );
+	wp = WPPin( chip );
+	
+	*cs.ddr &= ~cs.mask;
+	*wp.ddr &= ~wp.mask;
+}
+
+
+/*************************************************************************
+Sends a command and a related address to the selected chip
+
+Inputs:
+	short chip	 - the chip to be tested
+	short Command	 - chip command
+	long Address - the address to be tested
+	
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure
+	
+NOTE:  Leaves !CS set low on exit	
+*************************************************************************/
+inline short	SendCommandAndAddress( short chip, short Command, long Address )
 {
-	//	Only do this if defined
-	if( WP_USED )
-		if( ClearWP( chip ) )
-			return MEMFAIL;
-		
-	//	Set !CS low to talk
-	if( ClearCS( chip ) )
+	//	Send the command to the selected chip
+	if( SendCommand( chip, Command ) )
 		return MEMFAIL;
-	
-	//	Send Power Down command
-	if( SendCommand( chip, MDPD ) )
+		
+	if( SendAddress( chip, Address ) )
 		return MEMFAIL;
+		
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Sends a command to the selected chip
+
+Inputs:
+	short chip	 - the chip to be tested
+	short Command	 - chip command
 	
-	//	Command successfully sent - set !CS high
-	if( SetCS( chip ) )
-		return MEMFAIL;
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure
 	
+NOTE:  Leaves !CS set low on exit	
+*************************************************************************/
+inline short	SendCommand( short chip, short Command )
+{
+	MemPin	cs;
 	
-	//	Welp.  Chip is asleep.  Time to go home.
-	return MEMSUCC;
+	return BeginCommand( chip, (uint8_t)Command, &cs );
 }
 
 /*************************************************************************
-Read Status Register Instruction
-(RDSR)
-The Read Status Register instruction (RDSR) provides
-access to the STATUS register. The STATUS register
-may be read at any time, even during a write cycle. The
-STATUS register is formatted as follows:
-TABLE 2-2: STATUS REGISTER
+Starts a transaction:  resolves the !CS pin for the chip, pulls !CS low,
+and sends the command.  Pass the pin back to EndCommand() when done, so
+the chip -> pin lookup only happens once per transaction.
 
-The Write-In-Process (WIP) bit indicates whether the
-25AA1024 is busy with a write operation. When set to
-a 1, a write is in progress, when set to a 0, no write
-is in progress. This bit is read-only.
+Inputs:
+	short chip	 - the chip to be talked to
+	uint8_t Command	 - chip command
+	
+Returns
+	MemPin* cs	- the !CS pin for this chip
+	MEMSUCC	- on success
+	MEMFAIL	- on failure
+	
+NOTE:  Leaves !CS set low on exit	
+NOTE:  While an async transfer has the bus, no pin is touched and cs 
+	comes back with no bits, so the caller's EndCommand() is a no-op 
+	(raising !CS there would cut the transfer short).
+*************************************************************************/
+short	BeginCommand( short chip, uint8_t Command, MemPin* cs )
+{
+	*cs = CSPin( chip );
+	
+#if ASYNC_USED
+	//	The bus belongs to the ISR until the async transfer is done
+	if( AsyncBusy() )
+	{
+		cs->mask = 0;
+		return MEMFAILED( chip, STATF_BUS );
+	}
+#endif
 
-The Write Enable Latch (WEL) bit indicates the status
-of the write enable latch and is read-only. When set to
-a 1, the latch allows writes to the array, when set to a
-0, the latch prohibits writes to the array. The state of
-this bit can always be updated via the WREN or WRDI
-commands regardless of the state of write protection
-on the STATUS register. These commands are shown
-in Figure 2-4 and Figure 2-5.
+	//	An open reader would see this command as more clocks on its READ
+	ReaderSuspend();
 
-The Block Protection (BP0 and BP1) bits indicate
-which blocks are currently write-protected. These bits
-are set by the user issuing the WRSR instruction. These
-bits are nonvolatile and are shown in Table 2-3.
-See Figure 2-6 for the RDSR timing sequence.
+#if AUTOSLEEP_USED
+	//	RDID is the wake-up itself;  anything else needs an awake chip
+	if( Command == MRDID )
+	{
+		if( chip < NUM_CHIPS )
+			PowerAsleep[chip] = MEMFALSE;
+	}
+	else if( PowerWake( chip ) )
+		return MEMFAILED( chip, STATF_BUS );
+#endif
+
+	XportRate( chip );
+	
+	if( SelectPin( cs ) )
+		return MEMFAILED( chip, STATF_BUS );
+	
+#if STATS_USED
+	StatChip = chip;
+	MEMSTAT( chip, selects, 1 );
+	MEMSTAT( chip, commands[StatOp( Command )], 1 );
+#endif
+	
+	XferErr = MEMFALSE;
+	XferOut( Command );
+	
+	return XferErr ? MEMFAIL : MEMSUCC;
+}
 
-WARNING:  Leaves CS low at exit
+/*************************************************************************
+Ends a transaction started with BeginCommand() (raises !CS)
 *************************************************************************/
-short	ReadMemStatus( short chip, short* status )
+short	EndCommand( const MemPin* cs )
 {
-	short	temp;
+	return DeselectPin( cs );
+}
+
+
+/*************************************************************************
+Sends a byte
+
+Inputs:
+	short Command	 - chip command
 	
-	//  Read the status register to ensure the WREN bit was set (or BP bits, etc)
-	//	Send the command to read the status register
-	if( SendCommand( chip, MRDSR ) )
-		return MEMFAIL;
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure
+	
+NOTE:  Leaves !CS set low on exit	
+NOTE:	Unlike SendCommand(), this function expects that !CS is 
+		already set low.  (and memory already selected)
+*************************************************************************/
+inline short	SendByte( short byte )
+{
+	XferErr = MEMFALSE;
+	XferOut( (uint8_t)byte );
+	
+	return XferErr ? MEMFAIL : MEMSUCC;
+}
+
+
+/*************************************************************************
+Sends an address to the selected chip
+
+Inputs:
+	short chip	 - the chip to be tested
+	long Address - the address to be tested
+	
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure
+	
+NOTE:  Assumes !CS is already low on entrance
+		(we should never be sending an address without 1st sending a command)
+*************************************************************************/
+inline short	SendAddress( short chip, long Address )
+{
+	//  Send the address, MSB first.  One error check for all three bytes.
+	XferErr = MEMFALSE;
+	XferOut( (uint8_t)(Address >> 16) );
+	XferOut( (uint8_t)(Address >> 8) );
+	XferOut( (uint8_t)Address );
 		
+	return XferErr ? MEMFAIL : MEMSUCC;
+}
+
+/*************************************************************************
+Reads a byte from the selected chip
+
+Inputs:
+	short chip	 - the chip to be tested
+	
+Returns
+	short*	byte - pointer to the data loaction
+	MEMSUCC	- on success
+	MEMFAIL	- on failure
+	
+NOTE:  Leaves !CS set low on exit	
+
+NOTE:  There should never be data coming from the memory if !CS is not low
+		Therefore, we are assuming that CS is low at the start of this function
+*************************************************************************/
+inline short	ReadByte( short* byte )
+{
 	//	Read back the data
-	if( ReadByte( &temp ) )
-		return MEMFAIL;
+	XferErr = MEMFALSE;
+	*byte = XferIn();
 	
-	*status = temp;
+	return XferErr ? MEMFAIL : MEMSUCC;	
+}
+
+
+/*************************************************************************
+Sets !CS high for selected chip (enable comms)
+
+Inputs:
+	short chip	 - the chip to be tested
 	
-	return MEMSUCC;		
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure
+	
+NOTE:  Leaves !CS set high on exit	
+
+NOTE:  Don't call this for something timing critical/sensitive, 
+		as error checking uses up a few clock ticks
+*************************************************************************/
+short	SetCS( short chip )
+{
+	MemPin	cs = CSPin( chip );
+	
+#if ASYNC_USED
+	//	Only ever a failed command's clean-up while the ISR has the bus - 
+	//		and the chip may be the one it's talking to
+	if( AsyncBusy() )
+		return MEMFAIL;
+#endif
+	
+	return DeselectPin( &cs );
 }
 
 /*************************************************************************
-Write Status Register Instruction
-(WRSR)
-The Write Status Register instruction (WRSR) allows the
-user to write to the nonvolatile bits in the STATUS
-register as shown in Table 2-2. The user is able to
-select one of four levels of protection for the array by
-writing to the appropriate bits in the STATUS register.
-The array is divided up into four segments. The user
-has the ability to write-protect none, one, two, or all four
-of the segments of the array. The partitioning is
-controlled as shown in Table 2-3.
+Sets !CS low for selected chip (enable comms)
 
-The Write-Protect Enable (WPEN) bit is a nonvolatile
-bit that is available as an enable bit for the WP pin. The
-Write-Protect (WP) pin and the Write-Protect Enable
-(WPEN) bit in the STATUS register control the
-programmable hardware write-protect feature. Hardware
-write protection is enabled when WP pin is low
-and the WPEN bit is high. Hardware write protection is
-disabled when either the WP pin is high or the WPEN
-bit is low. When the chip is hardware write-protected,
-only writes to nonvolatile bits in the STATUS register
-are disabled. See Table 2-4 for a matrix of functionality
-on the WPEN bit.
+Inputs:
+	short chip	 - the chip to be tested
+	
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure
+	
+NOTE:  Leaves !CS set low on exit	
 
-See Figure 2-7 for the WRSR timing sequence
+NOTE:  Don't call this for something timing critical/sensitive, 
+		as error checking uses up a few clock ticks
+*************************************************************************/
+short	ClearCS( short chip )
+{
+	MemPin	cs = CSPin( chip );
+	
+#if ASYNC_USED
+	if( AsyncBusy() )
+		return MEMFAIL;
+#endif
+	
+	return SelectPin( &cs );
+}
+
+
+
+/*************************************************************************
+Page Erase
+The Page Erase instruction will erase all bits (FFh)
+inside the given page. A Write Enable (WREN)
+instruction must be given prior to attempting a Page
+Erase. This is done by setting CS low and then clocking
+out the proper instruction into the 25AA1024. After all
+eight bits of the instruction are transmitted, the CS must
+be brought high to set the write enable latch.
+
+The Page Erase instruction is entered by driving CS
+low, followed by the instruction code (Figure 2-8), and
+three address bytes. Any address inside the page to be
+erased is a valid address.
+
+CS must then be driven high after the last bit of the
+address or the Page Erase will not execute. Once the
+CS is driven high, the self-timed Page Erase cycle is
+started. The WIP bit in the STATUS register can be
+read to determine when the Page Erase cycle is
+complete.
+
+If a Page Erase instruction is given to an address that
+has been protected by the Block Protect bits (BP0,
+BP1) then the sequence will be aborted and no erase
+will occur.
+*************************************************************************/
+short	ErasePage( short chip, long Address )
+{
+	short	prot;
+	
+	prot = CheckProtect( chip, Address );
+	if( prot != MEMFALSE )
+		return MEMFAILED( chip, STATF_ERASE );			//	Protected, or couldn't tell
+	
+	if( StartErase( chip, MPE, Address ) )
+		return MEMFAILED( chip, STATF_ERASE );
+	
+	return WaitWriteComplete( chip, MTPE );
+}
+
+/*************************************************************************
+Sector Erase
+The Sector Erase instruction will erase all bits (FFh)
+inside the given sector. A Write Enable (WREN)
+instruction must be given prior to attempting a Sector
+Erase.
+
+The Sector Erase instruction is entered by driving CS
+low, followed by the instruction code (Figure 2-9), and
+three address bytes. Any address inside the sector to
+be erased is a valid address.
+
+CS must then be driven high after the last bit of the
+address or the Sector Erase will not execute.  If a Sector
+Erase instruction is given to an address that has been
+protected by the Block Protect bits (BP0, BP1) then the
+sequence will be aborted and no erase will occur.
+*************************************************************************/
+short	EraseSector( short chip, long Address )
+{
+	short	prot;
+	
+	//	The protected area always starts on a sector boundary, so checking
+	//		the top of the sector covers the whole thing
+	prot = CheckProtect( chip, Address | (SECTOR_SIZE - 1) );
+	if( prot != MEMFALSE )
+		return MEMFAILED( chip, STATF_ERASE );
+	
+	if( StartErase( chip, MSE, Address ) )
+		return MEMFAILED( chip, STATF_ERASE );
+	
+	return WaitWriteComplete( chip, MTSE );
+}
 
-Get that!?  Gotta set the WPEN bit to write protect the memory!
+/*************************************************************************
+Chip Erase
+The Chip Erase instruction will erase all bits (FFh) in
+the array. A Write Enable (WREN) instruction must be
+given prior to executing a Chip Erase.
+
+The Chip Erase instruction is entered by driving the CS
+low, followed by the instruction code (Figure 2-10) onto
+the SI line.
+
+The CS pin must be driven high after the eighth bit of
+the instruction code has been given or the Chip Erase
+instruction will not be executed.  The Chip Erase
+instruction is ignored if either of the Block Protect bits
+(BP0, BP1) are not 0, meaning 1/4, 1/2, or all of the
+array is protected.
 *************************************************************************/
-short	WriteMemStatus( short chip, short* status )
+short	EraseChip( short chip )
 {
-	short	temp;
-	short	new_status;
+	long	limit;
 	
-	temp = *status;
+	if( ProtectLimit( chip, &limit ) || (limit != BP00) )
+		return MEMFAILED( chip, STATF_ERASE );
 	
-	//  De-assert the !WP pin
-	if( SetWP( chip ) )
-		return MEMFAIL;
+	if( StartErase( chip, MCE, 0 ) )
+		return MEMFAILED( chip, STATF_ERASE );
 	
-	//	Send the command to write the status register
-	if( SendCommand( chip, MWRSR ) )
-		return MEMFAIL;
-		
-	//	Send the status byte
-	if( SendByte( temp ) )
-		return MEMFAIL;
+	return WaitWriteComplete( chip, MTCE );
+}
 
-	//  Re-assert the !WP pin
-	if( ClearWP( chip ) )
-		return MEMFAIL;
+/*************************************************************************
+Erases every chip at once:  WREN + CE goes to each chip back to back, 
+then they're all waited out together - one chip erase time in total, 
+not NUM_CHIPS of them.
+
+Returns
+	MEMSUCC	- all chips erased
+	MEMFAIL	- a chip failed, or has block protection set (CE would be 
+		ignored).  The other chips are still erased.
+*************************************************************************/
+short	FormatAll( void )
+{
+	uint8_t	mask = 0;
+	short	err = MEMSUCC;
+	long	limit;
+	short	chip;
 	
-	//  Read back the status for verification
-	if( ReadMemStatus( chip, &new_status) )
+	//	A WREN to a busy chip gets ignored, and so would the CE
+	if( WaitAllComplete( (1 << NUM_CHIPS) - 1, MTCE ) )
 		return MEMFAIL;
-		
-	if( (temp & 0x8C) != (new_status & 0x8C) )
+	
+	for( chip=0 ; chip<NUM_CHIPS ; chip++ )
+	{
+		if( ProtectLimit( chip, &limit ) || (limit != BP00) || StartErase( chip, MCE, 0 ) )
+			err = MEMFAIL;
+		else
+			mask |= 1 << chip;
+	}
+	
+	if( WaitAllComplete( mask, MTCE ) )
 		return MEMFAIL;
-		
-	return MEMSUCC;		
+	
+	return err;
 }
 
-
 /*************************************************************************
-based on the input chip number, returns the appropriate CS for control
-input:
-	short	chip (0-4)
-returns:
-	short	CS
+Kicks off an erase (MPE, MSE or MCE) and returns without waiting for it.
+No protection check - the chip will just ignore a protected erase, but 
+the page map (PAGEMAP_USED) counts it as done.  So check first if the 
+pages could be protected.
+
+Inputs:
+	short chip	 - the chip to be erased
+	uint8_t Command	 - MPE, MSE or MCE
+	long Address - any address in the page/sector (ignored for MCE)
+	
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure
 *************************************************************************/
-inline short	GetCS( short chip )
+short	StartErase( short chip, uint8_t Command, long Address )
 {
-	switch( chip )
+	MemPin	cs;
+	
+	if( WriteEnable( chip ) )
+		return MEMFAILED( chip, STATF_ERASE );
+	
+	if( BeginCommand( chip, Command, &cs ) )
 	{
-		case 0: return CS0;
-		case 1: return CS1;
-		case 2:	return CS2;
-		case 3: return CS3;
-		default: return CS0;
+		EndCommand( &cs );
+		return MEMFAILED( chip, STATF_ERASE );
 	}
 	
-	return CS0;
+	if( Command != MCE )
+		if( SendAddress( chip, Address ) )
+		{
+			EndCommand( &cs );
+			return MEMFAILED( chip, STATF_ERASE );
+		}
+	
+	//	!CS high starts the erase
+	if( EndCommand( &cs ) )
+		return MEMFAILED( chip, STATF_ERASE );
+	
+#if PAGEMAP_USED
+	MapErased( chip, Command, Address );
+#endif
+#if WEAR_USED
+	WearErased( chip, Command, Address );
+#endif
+	
+	return MEMSUCC;
 }
 
 /*************************************************************************
-based on the input chip number, returns the appropriate WP for control
-input:
-	short	chip (0-4)
-returns:
-	short	WP
+Erases [Address, Address+NumBytes) with as few erase cycles as possible:
+the whole chip if that's what was asked for, sector erases for every 
+whole sector in the range, and page erases for the rest.
+
+Anything in the range that is block protected is skipped (the protected
+area is always at the top of the array, so the range is just clipped) -
+and still counts as success, as long as something was left to erase.
+
+Inputs:
+	short chip	 - the chip to be erased
+	long Address - start of the range.  Must be page aligned.
+	long NumBytes - length of the range.  Must be a multiple of PAGE_SIZE.
+	
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure, a range that isn't page aligned, or a range 
+		that's all block protected
 *************************************************************************/
-short	GetWP( short chip )
+short	EraseRange( short chip, long Address, long NumBytes )
 {
-	switch( chip )
+	long	limit;			//	Highest unprotected address (-1 = none)
+	long	end;
+	
+	if( CheckRange( Address, NumBytes ) )
+		return MEMFAILED( chip, STATF_ERASE );
+	
+	if( (Address & (PAGE_SIZE - 1)) || (NumBytes & (PAGE_SIZE - 1)) )
+		return MEMFAILED( chip, STATF_ERASE );
+	
+	if( ProtectLimit( chip, &limit ) )
+		return MEMFAILED( chip, STATF_ERASE );
+	
+	end = Address + NumBytes;
+	if( end > (limit + 1) )
+		end = limit + 1;
+	
+	//	Asked to erase protected memory and nothing else
+	if( (NumBytes > 0) && (Address >= end) )
+		return MEMFAILED( chip, STATF_ERASE );
+	
+	//	Everything?  One chip erase does it.
+	if( (Address == 0) && (end == (MEMSIZE + 1)) )
+		return EraseChip( chip );
+	
+	while( Address < end )
 	{
-		case 0: return WP0;
-		case 1: return WP1;
-		case 2:	return WP2;
-		case 3: return WP3;
-		default: return WP0;
+		if( !(Address & (SECTOR_SIZE - 1)) && ((Address + SECTOR_SIZE) <= end) )
+		{
+			if( StartErase( chip, MSE, Address ) || WaitWriteComplete( chip, MTSE ) )
+				return MEMFAILED( chip, STATF_ERASE );
+			
+			Address += SECTOR_SIZE;
+		}
+		else
+		{
+			if( StartErase( chip, MPE, Address ) || WaitWriteComplete( chip, MTPE ) )
+				return MEMFAILED( chip, STATF_ERASE );
+			
+			Address += PAGE_SIZE;
+		}
 	}
 	
-	return WP0;
+	return MEMSUCC;
 }
 
 /*************************************************************************
-Initializes the selected memory (sets control inputs to known values)
-	Also "wakes" memory
-input:
-	short	chip (0-4)
-Affects:
-	Appropriate CS line (low)
-	Appropriate WP line (hi)
+Checks whether an address is write protected by the BP bits
+
+Returns
+	MEMTRUE		- protected
+	MEMFALSE	- not protected
+	MEMFAIL		- couldn't read the status register
 *************************************************************************/
-short	InitMem( short chip )
+short	CheckProtect( short chip, long Address )
 {
-
-	switch ( chip )
-	{
-		case 0: 
-			ContDDR |= (1<<CS0);
-			ContDDR |= (1<<WP0);
-			break;
-		case 1: 
-			ContDDR |= (1<<CS1);
-			ContDDR |= (1<<WP1);
-			break;
-		case 2: 
-			ContDDR |= (1<<CS2);
-			ContDDR |= (1<<WP2);
-			break;
-		case 3: 
-			ContDDR |= (1<<CS3);
-			ContDDR |= (1<<WP3);
-			break;
-		default:
-			return MEMFAIL;
-	}
-/*	
-	//	Wake the memory
-	if( WakeMem( chip ) )
+	long	limit;
+	
+	if( ProtectLimit( chip, &limit ) )
 		return MEMFAIL;
-*/		
-	//  Set !WP low (if used)
-	if( WP_USED )
-		if( ClearWP( chip ) )	
-			return MEMFAIL;
-			
-	return MEMSUCC;
+	
+	if( Address > limit )
+		return MEMTRUE;
+	
+	return MEMFALSE;
 }
 
-void CloseMem( short chip )
+/*************************************************************************
+Reads the BP bits and returns the highest UNPROTECTED address 
+(one of BP00, BP01, BP10), or -1 if the whole array is protected
+*************************************************************************/
+short	ProtectLimit( short chip, long* limit )
 {
-	switch ( chip )
+	short	status;
+	
+	if( ReadMemStatus( chip, &status ) )
+		return MEMFAIL;
+	
+	switch( (status >> MBP0) & 0x03 )
 	{
-		case 0: 
-			ContDDR &= ~(1<<CS0);
-			ContDDR &= ~(1<<WP0);
-			break;
-		case 1: 
-			ContDDR &= ~(1<<CS1);
-			ContDDR &= ~(1<<WP1);
-			break;
-		case 2: 
-			ContDDR &= ~(1<<CS2);
-			ContDDR &= ~(1<<WP2);
-			break;
-		case 3: 
-			ContDDR &= ~(1<<CS3);
-			ContDDR &= ~(1<<WP3);
-			break;
-		default:
-			return;
+		case 0:	*limit = BP00;	break;
+		case 1:	*limit = BP01;	break;
+		case 2:	*limit = BP10;	break;
+		default: *limit = -1;	break;		//	BP11 - nothing is writable
 	}
 	
+	return MEMSUCC;
 }
 
+/*************************************************************************
+Sets !WP high for selected chip (disable write protection)
+
+Inputs:
+	short chip	 - the chip to be tested
+	
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure
+	
+NOTE:  Leaves !WP set high on exit	
+
+NOTE:  Don't call this for something timing critical/sensitive, 
+		as error checking and pin lookup uses up a few clock ticks
+*************************************************************************/
+short	SetWP( short chip )
+{
+	MemPin	wp = WPPin( chip );
+	
+	return DeselectPin( &wp );
+}
 
 /*************************************************************************
-Sends a command and a related address to the selected chip
+Sets !WP low for selected chip (Write Protect)
 
 Inputs:
 	short chip	 - the chip to be tested
-	short Command	 - chip command
-	long Address - the address to be tested
 	
 Returns
 	MEMSUCC	- on success
 	MEMFAIL	- on failure
 	
-NOTE:  Leaves !CS set low on exit	
+NOTE:  Leaves !WP set low on exit	
+
+NOTE:  Don't call this for something timing critical/sensitive, 
+		as error checking and lookups use up a few clock ticks
 *************************************************************************/
-inline short	SendCommandAndAddress( short chip, short Command, long Address )
+short	ClearWP( short chip )
 {
-	//	Send the command to the selected chip
-	if( SendCommand( chip, Command ) )
+	MemPin	wp = WPPin( chip );
+	
+	return SelectPin( &wp );
+}
+
+
+/*************************************************************************
+Checks the WIP bit in the status word 
+*************************************************************************/
+short	CheckWIP( short chip )
+{
+	short	status;
+	
+	//	Get the status
+	if( ReadMemStatus( chip, &status ) )
 		return MEMFAIL;
 		
-	if( SendAddress( chip, Address ) )
-		return MEMFAIL;
+	if( (status & (1<<MWIP)) )	//  Will be 1 until WIP bit is cleared
+		return MEMTRUE;
 		
-	return MEMSUCC;
+	return MEMFALSE;
 }
 
 /*************************************************************************
-Sends a command to the selected chip
+Non-blocking busy check - one status register read, properly framed
 
 Inputs:
 	short chip	 - the chip to be tested
-	short Command	 - chip command
 	
 Returns
-	MEMSUCC	- on success
-	MEMFAIL	- on failure
+	MEMTRUE		- write/erase cycle still in progress
+	MEMFALSE	- idle, ready for the next command
+	MEMFAIL		- couldn't talk to the memory
+*************************************************************************/
+short	IsBusy( short chip )
+{
+	return CheckWIP( chip );
+}
+
+/*************************************************************************
+Waits for a write (or erase) cycle to finish by polling WIP.  Returns 
+as soon as the memory says it is done, rather than sitting out the 
+worst-case cycle time.
+
+Inputs:
+	short chip	 - the chip to be tested
+	unsigned short timeout	- give up after (roughly) this many ms.
+				The RDSR transaction time isn't counted, so the real
+				timeout is always a bit longer, never shorter.
 	
-NOTE:  Leaves !CS set low on exit	
+Returns
+	MEMSUCC	- WIP cleared
+	MEMFAIL	- timed out, or couldn't talk to the memory
 *************************************************************************/
-inline short	SendCommand( short chip, short Command )
+short	WaitWriteComplete( short chip, unsigned short timeout )
 {
-	//	Set CS low
-	ClearCS( chip );
+	unsigned long	polls;		//	Polls left before we give up
+	short			busy;
 	
-	//  Send the memory the command
-	if( SendByte( Command ) )
-		return MEMFAIL;
+	polls = ((unsigned long)timeout * 1000) / WIP_POLL_US;
+	
+	for( ;; )
+	{
+		busy = IsBusy( chip );
 		
-	return MEMSUCC;	
+		if( busy == MEMFALSE )
+			return MEMSUCC;
+		
+		if( (busy == MEMFAIL) || (polls == 0) )
+			return MEMFAILED( chip, STATF_WAIT );
+		
+		polls--;
+		MEMSTAT( chip, wipPolls, 1 );
+		MEMSTAT( chip, waitUs, WIP_POLL_US );
+		_delay_us( WIP_POLL_US );
+	}
+}
+
+/*************************************************************************
+Waits for a set of chips to all finish their write/erase cycles, polling 
+them in turn.  For when several have been started together - the wait is 
+as long as the slowest one, not the sum.
+
+Inputs:
+	uint8_t mask	- bit n set = wait for chip n
+	unsigned short timeout	- give up after this many ms
+	
+Returns
+	MEMSUCC	- all idle
+	MEMFAIL	- timed out, or couldn't read a status register
+*************************************************************************/
+short	WaitAllComplete( uint8_t mask, unsigned short timeout )
+{
+	unsigned long	polls;
+	short			busy;
+	short			chip;
+	
+	polls = ((unsigned long)timeout * 1000) / WIP_POLL_US;
+	
+	for( ;; )
+	{
+		for( chip=0 ; chip<NUM_CHIPS ; chip++ )
+		{
+			if( !(mask & (1 << chip)) )
+				continue;
+			
+			busy = IsBusy( chip );
+			if( busy == MEMFAIL )
+				return MEMFAILED( chip, STATF_WAIT );
+			
+			if( busy == MEMFALSE )
+				mask &= ~(1 << chip);		//	Done - stop asking it
+		}
+		
+		if( !mask )
+			return MEMSUCC;
+		
+		if( polls == 0 )
+		{
+			//	Timed out:  charge it to the first chip still busy
+			for( chip=0 ; !(mask & (1 << chip)) ; chip++ )
+				;
+			return MEMFAILED( chip, STATF_WAIT );
+		}
+		
+		polls--;
+		_delay_us( WIP_POLL_US );
+	}
+}
+
+
+#if ASYNC_USED
+/*************************************************************************
+Asynchronous (interrupt driven) transfers
+
+MemSubmit() selects the chip, loads the command byte and starts the 
+clock, then returns right away.  An interrupt fires after each byte, 
+stores what came in, and loads the next byte.  After the last byte the
+ISR raises !CS and calls req->callback( req, MEMSUCC ) - from interrupt
+context, so keep it short.
+
+On the USI, Timer0's compare match strobes the clock (the USI can't
+generate SCK by itself in three-wire mode) and the counter overflow is
+the byte interrupt.  On the hardware SPI, the byte interrupt is the 
+SPI's own (SPI_STC_vect) and SCK runs at full speed.
+
+Only one request can be in flight.  Everything else that talks to the 
+memory fails with MEMFAIL until it completes (see BeginCommand()).
+
+Reads (MREAD) can be any length.  Writes (MWRITE) must fit inside one 
+page;  MemSubmit() sends the WREN first, and the callback runs when 
+!CS goes high - the write cycle is still running at that point, so 
+IsBusy()/WaitWriteComplete() before the next write to that chip.
+
+USI SCK runs at F_CPU / (2 * ASYNC_HALFBIT).  Each half bit costs an 
+interrupt, so don't make ASYNC_HALFBIT so small the ISRs eat the CPU.
+*************************************************************************/
+#if MEMXPORT == XPORT_USI
+
+#define ASYNC_USICR	((1<<USIOIE)|(1<<USIWM0)|(1<<USICS1)|(1<<USICLK))
+
+//	Load the first byte, clear the USI counter, and start the clock
+static inline void	AsyncStart( uint8_t first )
+{
+	USIDR = first;
+	USISR = (1<<USIOIF);
+	USICR = ASYNC_USICR;
+	
+	TCNT0 = 0;
+	OCR0A = ASYNC_HALFBIT - 1;
+	TCCR0A = (1<<WGM01);			//	CTC
+	TIMSK0 |= (1<<OCIE0A);
+	TCCR0B = (1<<CS00);				//	No prescale
+}
+
+static inline void	AsyncLoad( uint8_t next )
+{
+	USIDR = next;
+	USISR = (1<<USIOIF);			//	Clear the flag (and counter) - clock resumes
+}
+
+static inline void	AsyncStop( void )
+{
+	TCCR0B = 0;
+	TIMSK0 &= ~(1<<OCIE0A);
+	USICR = 0;
+	USISR = (1<<USIOIF);
+}
+
+#elif MEMXPORT == XPORT_HWSPI
+
+static inline void	AsyncStart( uint8_t first )
+{
+	SPCR |= (1<<SPIE);
+	SPDR = first;
+}
+
+static inline void	AsyncLoad( uint8_t next )
+{
+	SPDR = next;
+}
+
+static inline void	AsyncStop( void )
+{
+	SPCR &= ~(1<<SPIE);
 }
 
+#else
+#error "ASYNC_USED needs MEMXPORT to be XPORT_USI or XPORT_HWSPI"
+#endif
 
-/*************************************************************************
-Sends a byte
+static MemRequest* volatile	AsyncReq;		//	Request in flight (0 if idle)
+static volatile uint16_t	AsyncPos;		//	Bytes (header + data) shifted so far
+static MemPin				AsyncCS;		//	!CS pin of the chip being talked to
 
-Inputs:
-	short Command	 - chip command
+//	Byte number pos of the transfer:  command, 3 address bytes, then data
+static inline uint8_t	AsyncByte( MemRequest* req, uint16_t pos )
+{
+	switch( pos )
+	{
+		case 0: return req->Command;
+		case 1: return (uint8_t)(req->Address >> 16);
+		case 2: return (uint8_t)(req->Address >> 8);
+		case 3: return (uint8_t)req->Address;
+	}
 	
-Returns
-	MEMSUCC	- on success
-	MEMFAIL	- on failure
+	if( req->Command == MWRITE )
+		return req->data[pos - 4];
 	
-NOTE:  Leaves !CS set low on exit	
-NOTE:	Unlike SendCommand(), this function expects that !CS is 
-		already set low.  (and memory already selected)
-*************************************************************************/
-inline short	SendByte( short byte )
-{
-	//  Send the memory the command
-	if( SPI_Write_Byte( byte ) )
-		return MEMFAIL;
-		
-	return MEMSUCC;	
+	return 0xFF;
 }
 
-
-/*************************************************************************
-Sends an address to the selected chip
-
-Inputs:
-	short chip	 - the chip to be tested
-	long Address - the address to be tested
+short	MemSubmit( MemRequest* req )
+{
+	if( AsyncBusy() )
+		return MEMFAIL;
 	
-Returns
-	MEMSUCC	- on success
-	MEMFAIL	- on failure
+	if( (req->Command != MREAD) && (req->Command != MWRITE) )
+		return MEMFAIL;
 	
-NOTE:  Assumes !CS is already low on entrance
-		(we should never be sending an address without 1st sending a command)
-*************************************************************************/
-inline short	SendAddress( short chip, long Address )
-{
-	short	Addr_Hi;		//  High byte of address (Most significant)
-	short	Addr_LoHi;		//	Middle byte of address
-	short	Addr_LoLo;		//	Lowest byte of address (Least significant)
+	if( req->Command == MWRITE )
+	{
+		if( req->NumBytes > PageRemain( req->Address ) )
+			return MEMFAIL;
+		
+		if( WriteEnable( req->chip ) )
+			return MEMFAIL;
+		
+#if PAGEMAP_USED
+		MapWritten( req->chip, req->Address );
+#endif
+#if WEAR_USED
+		WearProgrammed( req->chip, req->Address );
+#endif
+	}
 	
-	//  Split up the address into its various bytes for transmission
-	Addr_Hi = (short)((Address >> 16) & 0x000000FF);
-	Addr_LoHi = (short)((Address >> 8) & 0x000000FF);
-	Addr_LoLo = (short)(Address & 0x000000FF);
+	ReaderSuspend();
 	
-	//  Send the address
-	if( SendByte( Addr_Hi ) )
-		return MEMFAIL;
-
-	if( SendByte( Addr_LoHi ) )
+#if AUTOSLEEP_USED
+	if( PowerWake( req->chip ) )
 		return MEMFAIL;
-
-	if( SendByte( Addr_LoLo ) )
+#endif
+	
+	AsyncCS = CSPin( req->chip );
+	XportRate( req->chip );
+	
+	if( SelectPin( &AsyncCS ) )
+	{
+		DeselectPin( &AsyncCS );
 		return MEMFAIL;
-		
-	return MEMSUCC;	
+	}
+	
+	AsyncPos = 0;
+	AsyncReq = req;
+	
+#if STATS_USED
+	MEMSTAT( req->chip, selects, 1 );
+	MEMSTAT( req->chip, commands[StatOp( req->Command )], 1 );
+	if( req->Command == MREAD )
+		MEMSTAT( req->chip, bytesRead, req->NumBytes );
+	else
+		MEMSTAT( req->chip, bytesWritten, req->NumBytes );
+#endif
+	
+	AsyncStart( req->Command );
+	
+	return MEMSUCC;
 }
 
-/*************************************************************************
-Reads a byte from the selected chip
+short	AsyncBusy( void )
+{
+	return (AsyncReq != 0) ? MEMTRUE : MEMFALSE;
+}
 
-Inputs:
-	short chip	 - the chip to be tested
+//	A byte just finished shifting
+static inline void	AsyncService( uint8_t in )
+{
+	MemRequest*	req = AsyncReq;
+	uint16_t	pos;
+	uint16_t	total;
 	
-Returns
-	short*	byte - pointer to the data loaction
-	MEMSUCC	- on success
-	MEMFAIL	- on failure
+	pos = AsyncPos;
 	
-NOTE:  Leaves !CS set low on exit	
+	if( (pos >= 4) && (req->Command == MREAD) )
+		req->data[pos - 4] = in;
+	
+	pos++;
+	total = req->NumBytes + 4;
+	
+	if( pos >= total )
+	{
+		//	Last byte - stop the clock and end the transaction
+		AsyncStop();
+		
+		AsyncReq = 0;
+		
+		req->callback( req, DeselectPin( &AsyncCS ) );
+		return;
+	}
+	
+	AsyncPos = pos;
+	AsyncLoad( AsyncByte( req, pos ) );
+}
 
-NOTE:  There should never be data coming from the memory if !CS is not low
-		Therefore, we are assuming that CS is low at the start of this function
-*************************************************************************/
-inline short	ReadByte( short* byte )
+#if MEMXPORT == XPORT_USI
+//	Half-bit clock for the USI
+ISR( TIM0_COMPA_vect )
 {
-	//	Read back the data
-	if( SPI_Read_Byte( SPIFALSE, byte ) )
-		return MEMFAIL;
-		
-	return MEMSUCC;	
+	//	Byte done but not serviced yet - hold the clock until it is
+	if( USISR & (1<<USIOIF) )
+		return;
+	
+	USICR = ASYNC_USICR | (1<<USITC);
 }
 
+ISR( USI_OVF_vect )
+{
+	AsyncService( USIDR );
+}
+#else
+ISR( SPI_STC_vect )
+{
+	AsyncService( SPDR );
+}
+#endif
+#endif
 
 /*************************************************************************
-Sets !CS high for selected chip (enable comms)
+Sequential reader
 
-Inputs:
-	short chip	 - the chip to be tested
-	
-Returns
-	MEMSUCC	- on success
-	MEMFAIL	- on failure
-	
-NOTE:  Leaves !CS set high on exit	
+Replaying records one ReadData() at a time costs the READ command and 
+3 address bytes on every call.  A MemReader leaves the READ running 
+(!CS low) between calls, and as long as the next call asks for the 
+address the chip is about to shift out anyway (it auto-increments), 
+it just keeps clocking.  Anything else re-sends command + address.
 
-NOTE:  Don't call this for something timing critical/sensitive, 
-		as error checking uses up a few clock ticks
+With READAHEAD set, each call also tops up a small buffer with the next
+READAHEAD bytes, so short records that follow each other can come 
+straight out of RAM.
+
+Any other command sent through this driver ends the READ first (see 
+BeginCommand()), and the reader simply restarts on its next call.
+
+NOTE:  While a reader is open nothing else may clock the SPI bus 
+	behind this driver's back - the memory would take it as more 
+	READ clocks.  ReaderClose() when done.
 *************************************************************************/
-short	SetCS( short chip )
+void	ReaderOpen( MemReader* rd, short chip )
 {
-	short	CCS;
-	short	temp;
+	rd->chip = chip;
+	rd->open = MEMFALSE;
+	rd->cs = CSPin( chip );
+	rd->Address = 0;
+#if READAHEAD
+	rd->count = 0;
+	rd->head = 0;
+	rd->bufAddr = 0;
+#endif
+}
+
+//	Ends the READ of whichever reader is holding the bus
+static void	ReaderSuspend( void )
+{
+	MemReader*	rd = ActiveReader;
+	
+	if( !rd )
+		return;
+	
+	ActiveReader = 0;
 	
-	//  get correct CS for this device
-	CCS = GetCS( chip );
+	if( rd->open )
+		DeselectPin( &rd->cs );
 	
-	//  Ensure !CS is low for comms
-	ContPort |= (1<<CCS);	
+	rd->open = MEMFALSE;
+#if READAHEAD
+	rd->count = 0;		//	Whatever made us stop may have changed the data
+#endif
+}
 
-	//  Wait a bit to ensure outputs are latched and settled
-	_NOP();
+short	ReaderRead( MemReader* rd, long Address, long NumBytes, uint8_t* data )
+{
+	long	chunk;
 	
-	//  Read back the port
-	temp = RContPort;
+#if READAHEAD
+	//	Serve what we can from the prefetch buffer
+	if( rd->count && (Address == rd->bufAddr) )
+	{
+		chunk = (NumBytes < rd->count) ? NumBytes : rd->count;
+		
+		memcpy( data, &rd->buf[rd->head], chunk );
+		
+		rd->head += (uint8_t)chunk;
+		rd->count -= (uint8_t)chunk;
+		rd->bufAddr += chunk;
+		
+		Address += chunk;
+		data += chunk;
+		NumBytes -= chunk;
+	}
+	else
+		rd->count = 0;
 	
-	if( (temp & (1<<CCS)) )		//	Should NOT be zero
+	if( !NumBytes )
 		return MEMSUCC;
+#endif
+
+	//	Restart the READ unless the chip is already sitting at Address
+	if( !rd->open || (rd->Address != (Address & MEMSIZE)) )
+	{
+		ReaderClose( rd );
 		
-	return MEMFAIL;
+		if( BeginCommand( rd->chip, MREAD, &rd->cs ) || SendAddress( rd->chip, Address ) )
+		{
+			EndCommand( &rd->cs );
+			return MEMFAIL;
+		}
+		
+		rd->open = MEMTRUE;
+		ActiveReader = rd;
+	}
+	
+	chunk = NumBytes;
+	
+	if( PumpRead( data, chunk ) )
+	{
+		ReaderClose( rd );
+		return MEMFAIL;
+	}
+	
+	//	The chip's address counter rolls over at the top
+	rd->Address = (Address + chunk) & MEMSIZE;
+	
+#if READAHEAD
+	//	Top up the buffer for next time
+	if( PumpRead( rd->buf, READAHEAD ) )
+	{
+		ReaderClose( rd );
+		return MEMFAIL;
+	}
+	
+	rd->bufAddr = rd->Address;
+	rd->head = 0;
+	rd->count = READAHEAD;
+	rd->Address = (rd->Address + READAHEAD) & MEMSIZE;
+#endif
+	
+	return MEMSUCC;
 }
 
-/*************************************************************************
-Sets !CS low for selected chip (enable comms)
-
-Inputs:
-	short chip	 - the chip to be tested
+short	ReaderClose( MemReader* rd )
+{
+	short	err = MEMSUCC;
 	
-Returns
-	MEMSUCC	- on success
-	MEMFAIL	- on failure
+	if( rd->open )
+		err = EndCommand( &rd->cs );
 	
-NOTE:  Leaves !CS set low on exit	
+	rd->open = MEMFALSE;
+#if READAHEAD
+	rd->count = 0;
+#endif
+	
+	if( ActiveReader == rd )
+		ActiveReader = 0;
+	
+	return err;
+}
 
-NOTE:  Don't call this for something timing critical/sensitive, 
-		as error checking uses up a few clock ticks
+/*************************************************************************
+Computes the page in which the address resides
 *************************************************************************/
-short	ClearCS( short chip )
+int		GetPage( long Address, int* page )
 {
-	short	CCS;
-	short	temp;
+	int	temp;
 	
-	//  get correct CS for this device
-	CCS = GetCS( chip );
+	temp = (int)(Address/PAGE_SIZE);
 	
-	//  Ensure !CS is low for comms
-	ContPort &= ~(1<<CCS);	
-
-	//  Wait a bit to ensure outputs are latched and settled
-	_NOP();
+	page = &temp;
 	
-	//  Read back the port
-	temp = RContPort;
+	page--; //	(we start with zero, right?)
 	
-	if( !(temp & (1<<CCS)) )		//	Should be zero
-		return MEMSUCC;
+	if( temp > 511 )
+		return MEMFAIL;
 		
-	return MEMFAIL;
+	return MEMSUCC;
 }
 
-
 /*************************************************************************
-Sets !WP high for selected chip (disable write protection)
+Returns the number of bytes from Address up to (and including) the last
+byte of its page
+*************************************************************************/
+long	PageRemain( long Address )
+{
+	return PAGE_SIZE - (Address & (PAGE_SIZE - 1));
+}
 
-Inputs:
-	short chip	 - the chip to be tested
+/*************************************************************************
+Checks that [Address, Address+NumBytes) lies inside the device
+*************************************************************************/
+short	CheckRange( long Address, long NumBytes )
+{
+	if( (Address < 0) || (NumBytes < 0) )
+		return MEMFAIL;
 	
-Returns
-	MEMSUCC	- on success
-	MEMFAIL	- on failure
+	if( (Address + NumBytes) > (MEMSIZE + 1) )
+		return MEMFAIL;
 	
-NOTE:  Leaves !WP set high on exit	
+	return MEMSUCC;
+}
 
-NOTE:  Don't call this for something timing critical/sensitive, 
-		as error checking and pin lookup uses up a few clock ticks
+#if HOLD_USED
+/*************************************************************************
+Bus sharing with !HOLD
+
+Other SPI devices on SCK/SI/SO (e.g. a radio) shouldn't have to wait out
+a long read.  They call MemBusRequest() - from an interrupt is fine - 
+and the running read pauses at the next HOLD_CHUNK byte boundary:
+!HOLD goes low (with SCK low, as the datasheet wants), the yield 
+function set with MemSetYield() does the other device's transfer, 
+!HOLD goes back high, and the read carries on from the next byte - no
+new command or address.  So the other device waits at most HOLD_CHUNK
+bytes' worth of clocks.
+
+Covers PumpRead() (ReadBytes, ReaderRead, the cache, etc.) and 
+ReadDataStream().  Writes aren't paused - the longest is one page.
+
+NOTE:  The yield function must NOT talk to the 25AA1024s, and must 
+	leave the SPI as it found it (mode, speed).
+NOTE:  With no read going, requests just wait for the next one - if 
+	nothing's running, just use the bus.  (But an open MemReader holds
+	!CS low between calls;  close it first.)
 *************************************************************************/
-short	SetWP( short chip )
+void	MemSetYield( MemYield fn, void* ctx )
 {
-	short	CWP;
-	short	temp;
-	
-	//	get the correct WP (for this device)	
-	CWP = GetWP( chip );
-	
-	//	Set it high
-	ContPort |= (1<<CWP);
+	HoldFn = fn;
+	HoldCtx = ctx;
+}
+
+void	MemBusRequest( void )
+{
+	HoldWanted = MEMTRUE;
+}
+
+static void	HoldYield( void )
+{
+	HoldWanted = MEMFALSE;
 	
-	//	Wait a bit
+	HOLDPort &= ~(1<<HOLD);
 	_NOP();
 	
-	//  Read back the port
-	temp = RContPort;
+	if( HoldFn )
+		HoldFn( HoldCtx );
 	
-	if( (temp & (1<<CWP)) )		//	Should NOT be zero
-		return MEMSUCC;
-		
-	return MEMFAIL;
+	HOLDPort |= (1<<HOLD);
+	_NOP();
 }
+#endif
 
+#if STATS_USED
 /*************************************************************************
-Sets !WP low for selected chip (Write Protect)
+Hot-path counters
+
+Counted as they happen, per chip:  data bytes in/out, commands by opcode
+(in StatOp() order:  READ, WRITE, WREN, WRDI, RDSR, WRSR, PE, SE, CE, 
+RDID, DPD, other), !CS cycles, WaitWriteComplete() polls and the time 
+spent between them, cache hits/misses, and MEMFAIL returns by function 
+group (STATF_xxx).  A failure deep down is counted by every group it
+passes through on the way out - e.g. a dead bus during WriteBytes() 
+shows in both STATF_BUS and STATF_WRITE.
 
 Inputs:
-	short chip	 - the chip to be tested
+	short chip	 - the chip
+	MemStats* stats	- where the snapshot goes
 	
 Returns
 	MEMSUCC	- on success
-	MEMFAIL	- on failure
-	
-NOTE:  Leaves !WP set low on exit	
-
-NOTE:  Don't call this for something timing critical/sensitive, 
-		as error checking and lookups use up a few clock ticks
+	MEMFAIL	- no such chip
 *************************************************************************/
-short	ClearWP( short chip )
+short	GetMemStats( short chip, MemStats* stats )
 {
-	short	CWP;
-	short	temp;
-	
-	//  get correct CS for this device
-	CWP = GetWP( chip );
-	
-	//  Ensure !CS is low for comms
-	ContPort &= ~(1<<CWP);	
-
-	//  Wait a bit to ensure outputs are latched and settled
-	_NOP();
+	if( (chip < 0) || (chip >= NUM_CHIPS) )
+		return MEMFAIL;
 	
-	//  Read back the port
-	temp = RContPort;
+	memcpy( stats, &MemStatsData[chip], sizeof(MemStats) );
 	
-	if( !(temp & (1<<CWP)) )		//	Should be zero
-		return MEMSUCC;
-		
-	return MEMFAIL;
+	return MEMSUCC;
 }
 
-
-/*************************************************************************
-Checks the WIP bit in the status word 
-*************************************************************************/
-short	CheckWIP( short chip )
+void	ClearMemStats( short chip )
 {
-	short	status;
+	if( (chip < 0) || (chip >= NUM_CHIPS) )
+		return;
 	
-	//	Get the status
-	if( ReadMemStatus( chip, &status ) )
-		return MEMFAIL;
-		
-	if( (status & (1<<MWIP)) )	//  Will be 1 until WIP bit is cleared
-		return MEMTRUE;
-		
-	return MEMFALSE;
+	memset( &MemStatsData[chip], 0, sizeof(MemStats) );
 }
 
-
-/*************************************************************************
-Computes the page in which the address resides
-*************************************************************************/
-int		GetPage( long Address, int* page )
+//	Counts a failure and hands back MEMFAIL, for "return MEMFAILED(...)"
+short	MemStatFail( short chip, short f )
 {
-	int	temp;
-	
-	temp = (int)(Address/PAGE_SIZE);
-	
-	page = &temp;
-	
-	page--; //	(we start with zero, right?)
+	MEMSTAT( chip, failures[f], 1 );
 	
-	if( temp > 511 )
-		return MEMFAIL;
-		
-	return MEMSUCC;
+	return MEMFAIL;
 }
+#endif
 
 /*  Returns the minimum of two integers */
 int		Min( int num1, int num2 )
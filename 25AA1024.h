@@ -41,6 +41,7 @@ NOTE:  This code may not work if you are running a particularly slow
 	so it may be easy to miss some stuff.
 *************************************************************************/
 #include <avr/io.h>
+#include <stdint.h>
 
 
 #ifndef _25AA1024_H_
@@ -53,10 +54,95 @@ NOTE:  This code may not work if you are running a particularly slow
 
 #define WP_USED		MEMFALSE	//  if microcontroller is running the !WP pin(s) (e.g., not hardwired), then change this to MEMTRUE
 
+#ifndef FASTSPI_USED
+#define FASTSPI_USED	MEMFALSE	//	Drive the USI directly (if the part has one) instead of through TinySPI
+#endif
+
+//	Bus transport (MEMXPORT).  Defaults to the USI if FASTSPI_USED and the 
+//		part has one, otherwise TinySPI.
+#define XPORT_TINYSPI	0			//	TinySPI library (SPI_Write_Byte / SPI_Read_Byte)
+#define XPORT_USI		1			//	USI strobed directly (ATtiny)
+#define XPORT_HWSPI		2			//	Hardware SPI peripheral (ATmega), F_CPU/2
+#ifndef MEMXPORT
+#if FASTSPI_USED && defined(USIDR)
+#define MEMXPORT		XPORT_USI
+#else
+#define MEMXPORT		XPORT_TINYSPI
+#endif
+#endif
+
+//	USI pins (MEMXPORT == XPORT_USI), made outputs by InitMem().  Defaults are the ATtiny84's.
+#ifndef USI_DDR
+#define USI_DDR			DDRA
+#define USI_DO			5
+#define USI_USCK		4
+#endif
+
+//	Hardware SPI pins (MEMXPORT == XPORT_HWSPI).  Defaults are the ATmega328P's.
+#ifndef HWSPI_DDR
+#define HWSPI_DDR		DDRB
+#define HWSPI_SS		2			//	Must be an output (or held high) for master mode
+#define HWSPI_MOSI		3
+#define HWSPI_SCK		5
+#endif
+#ifndef UNROLL_USED
+#define UNROLL_USED		MEMFALSE	//	Unroll the byte pump / USI clock strobes.  Faster, but bigger.
+#endif
+#ifndef ASYNC_USED
+#define ASYNC_USED		MEMFALSE	//	Interrupt driven transfers (MemSubmit).  USI:  takes over Timer0 and the USI interrupts.  Hardware SPI:  the SPI interrupt.
+#endif
+#define ASYNC_HALFBIT	32			//	CPU clocks per half SCK period in async mode (USI only)
+#ifndef CACHE_PAGES
+#define CACHE_PAGES		0			//	Pages of write-behind cache (0, 1 or 2).  PAGE_SIZE bytes of RAM each.
+#endif
+#ifndef AUTOSLEEP_USED
+#define AUTOSLEEP_USED	MEMFALSE	//	Put idle chips into deep power-down automatically (see PowerTick)
+#endif
+#ifndef SLEEP_AFTER
+#define SLEEP_AFTER		100			//	ms without a command before a chip is put to sleep (max 65535)
+#endif
+#ifndef FASTWAKE_USED
+#define FASTWAKE_USED	MEMTRUE		//	Automatic wake-ups skip the signature check (WakeMemFast)
+#endif
+#ifndef PAGEMAP_USED
+#define PAGEMAP_USED	0			//	In-RAM page state map (0 = off, 1 = erased bit, 2 = 2 bit state).  See 25AA1024Map.h
+#endif
+#ifndef WEAR_USED
+#define WEAR_USED		MEMFALSE	//	Program/erase cycle counters per page group.  See 25AA1024Wear.h
+#endif
+#ifndef STATS_USED
+#define STATS_USED		MEMFALSE	//	Hot-path counters (GetMemStats).  ~90 bytes of RAM per chip.
+#endif
+#ifndef HOLD_USED
+#define HOLD_USED		MEMFALSE	//	!HOLD is wired to a spare pin:  long reads can pause for other SPI devices (MemBusRequest)
+#endif
+#ifndef HOLD_CHUNK
+#define HOLD_CHUNK		32			//	Bytes between checks for a bus request
+#endif
+#ifndef SCKCAL_USED
+#define SCKCAL_USED		MEMFALSE	//	InitMem() finds the fastest SCK each chip works at (hardware SPI only).  See CalibrateSck
+#endif
+//	SCKCAL_ADDR has no default:  with SCKCAL_USED, define it as the start of 
+//		SCKCAL_LEN bytes kept for the test pattern - out of every volume, 
+//		log, KV, wear and bench area, and out of any block protected part.
+#define SCKCAL_LEN		16
+#ifndef SCKCAL_TRIES
+#define SCKCAL_TRIES	8			//	Passes a rate has to get through without an error
+#endif
+#ifndef SCKCAL_MARGIN
+#define SCKCAL_MARGIN	0			//	Rates to back off from the fastest that passed
+#endif
+#define SCK_RATES		7			//	Hardware SPI dividers:  F_CPU/2, /4, /8 ... /128
+#ifndef READAHEAD
+#define READAHEAD		0			//	Bytes of prefetch buffer per MemReader (0 = none, max 255)
+#endif
+
 //  Constants
 #define PAGE_SIZE	256			//	Device page size
 #define NUM_PAGES	512			//	Number of pages in the device
 #define MEMSIZE		0x01FFFF	//	Size of memory (in bytes)
+#define SECTOR_SIZE	0x8000		//	Sector size (for sector erase)
+#define NUM_SECTORS	4			//	Number of sectors in the device
 
 //	These constants are used for checking valid page addresses during erases - 
 //		these represent the HIGH address of the UNPROTECTED parts of the memory
@@ -73,7 +159,25 @@ NOTE:  This code may not work if you are running a particularly slow
 								//		after, say, a WREN command, then the write might fail.  Various functions 
 								//		look at this constant for timing.  (must be less than 255)
 
-//  TODO:  Extend to the use of multiple chips on same device - up to 4
+#ifndef F_CPU
+#define F_CPU		(IO_SPEED * 1000000UL)	//	util/delay.h needs this
+#endif
+
+//	Write cycle times (ms) - worst case, per the datasheet.  Used as timeouts
+//		for WIP polling;  most parts finish well before these.
+#define MTWC		6			//	Write cycle (byte/page write, WRSR)
+#define MTPE		6			//	Page erase
+#define MTSE		10			//	Sector erase
+#define MTCE		10			//	Chip erase
+#define WIP_POLL_US	20			//	Delay between WIP polls (us)
+#define MTREL_US	100			//	Release from deep power-down to standby (us)
+
+#define MEMCRC_INIT	0xFFFF		//	Starting value for the CRC-16 used for verification
+
+//  Up to 4 chips on the same device.  25AA1024Vol.h glues them into one address space.
+#ifndef NUM_CHIPS
+#define NUM_CHIPS	1			//	How many memories are actually fitted (1-4)
+#endif
 #define CS0			PORTA0		//  This is the pin that is tied to the memory's !CS pin (mem 0)
 #define CS1			PORTA1		//  This is the pin that is tied to the memory's !CS pin (mem 1)
 #define CS2			PORTA2		//  This is the pin that is tied to the memory's !CS pin (mem 2)
@@ -82,17 +186,53 @@ NOTE:  This code may not work if you are running a particularly slow
 #define RContPort	PINA		//	Port controlling the memory(ies) (for readback)
 #define ContDDR		DDRA
 
+//	Per-chip ports.  Default to ContPort for everything;  boards that put a 
+//		chip's !CS or !WP on a different port just override the three lines.
+#define CS0_PORT	ContPort
+#define CS0_PINR	RContPort
+#define CS0_DDR		ContDDR
+#define CS1_PORT	ContPort
+#define CS1_PINR	RContPort
+#define CS1_DDR		ContDDR
+#define CS2_PORT	ContPort
+#define CS2_PINR	RContPort
+#define CS2_DDR		ContDDR
+#define CS3_PORT	ContPort
+#define CS3_PINR	RContPort
+#define CS3_DDR		ContDDR
+
 #define WP0			PORTA4		//	Pin tied to the memory's !WP pin (if used - mem 0)
 #define WP1			PORTA5		//	Pin tied to the memory's !WP pin (if used - mem 1)
 #define WP2			PORTA6		//	Pin tied to the memory's !WP pin (if used - mem 2)
 #define WP3			PORTA7		//	Pin tied to the memory's !WP pin (if used - mem 3)
 
+#define WP0_PORT	ContPort
+#define WP0_PINR	RContPort
+#define WP0_DDR		ContDDR
+#define WP1_PORT	ContPort
+#define WP1_PINR	RContPort
+#define WP1_DDR		ContDDR
+#define WP2_PORT	ContPort
+#define WP2_PINR	RContPort
+#define WP2_DDR		ContDDR
+#define WP3_PORT	ContPort
+#define WP3_PINR	RContPort
+#define WP3_DDR		ContDDR
 
+
+#ifndef HOLDPort
+#if HOLD_USED
+#error "HOLD_USED needs HOLDPort, HOLD and HOLDDDR - the default !HOLD is the AVR's !RESET pin"
+#endif
 #define HOLDPort	PORTB		//	It's not on the control port (see below), so sue me...
 #define HOLD		PORTB3		//	Pin attached to the !HOLD pin.  Tied to AVR's !RESET pin, in this instance
 #define HOLDDDR		DDRB		//		This is wired this way so that in-circuit programming, which pulls !RESET
 								//		low, will "tell" the 25AA memory to ignore all inputs during the 
 								//		AVR programming...
+#endif
+								//	HOLD_USED needs !HOLD on a real GPIO instead:  define HOLDPort, HOLD
+								//		and HOLDDDR for it (all three) before including this header - 
+								//		without them a HOLD_USED build stops here rather than toggle !RESET.
 								
 
 
@@ -120,40 +260,258 @@ NOTE:  This code may not work if you are running a particularly slow
 
 		
 
+//	Types
+
+//	A control pin:  where to write it, where to read it back, its DDR, and its bit
+typedef struct
+{
+	volatile uint8_t*	port;
+	volatile uint8_t*	pin;
+	volatile uint8_t*	ddr;
+	uint8_t				mask;
+} MemPin;
+
+typedef struct MemRequest
+{
+	short		chip;			//	Which memory
+	uint8_t		Command;		//	MREAD or MWRITE
+	long		Address;		//	First address
+	uint8_t*	data;			//	Where the data comes from / goes to
+	uint16_t	NumBytes;		//	How much (MWRITE: must stay inside one page)
+	void		(*callback)( struct MemRequest* req, short status );	//	Called (from the ISR) when done
+	void*		ctx;			//	Caller's, not touched here
+} MemRequest;
+
+//	One piece of a scatter-gather transfer:  MemVec for ReadDataV, 
+//		MemConstVec for WriteDataV
+typedef struct
+{
+	void*		ptr;
+	uint16_t	len;
+} MemVec;
+
+typedef struct
+{
+	const void*	ptr;
+	uint16_t	len;
+} MemConstVec;
+
+//	Streaming callbacks (ReadDataStream / WriteDataStream).  Return MEMSUCC 
+//		to keep going, anything else to stop.
+typedef short	(*MemSink)( void* ctx, uint8_t byte );
+typedef short	(*MemSource)( void* ctx, uint8_t* byte );
+
+//	Runs another device's transfer while a read is on !HOLD (MemSetYield)
+typedef void	(*MemYield)( void* ctx );
+
+//	Sequential reader - keeps a READ going across calls (see ReaderRead)
+typedef struct
+{
+	short		chip;
+	long		Address;		//	Next address the chip will shift out
+	uint8_t		open;			//	MEMTRUE while !CS is held low on a READ
+	MemPin		cs;				//	!CS pin for chip
+#if READAHEAD
+	uint8_t		head;			//	Next unread byte in buf
+	uint8_t		count;			//	Unread bytes left in buf
+	long		bufAddr;		//	Address of buf[head]
+	uint8_t		buf[READAHEAD];
+#endif
+} MemReader;
+
+//	Counters (STATS_USED) - see GetMemStats()
+#define STAT_OPS		12			//	commands[]:  one per opcode (StatOp() in 25AA1024.c), + "other"
+#define STATF_BUS		0			//	failures[]:  couldn't select / clock the chip
+#define STATF_READ		1			//	ReadData, ReadBytes, CrcData
+#define STATF_WRITE		2			//	WriteData, WriteBytes, WritePage, BeginPageWrite, WriteBytesVerify (incl. mismatches), WriteDataIfChanged
+#define STATF_ERASE		3			//	ErasePage, EraseSector, EraseChip, EraseRange, StartErase
+#define STATF_STATUS	4			//	ReadMemStatus, WriteMemStatus
+#define STATF_WAIT		5			//	WaitWriteComplete, WaitAllComplete (timeouts)
+#define STATF_POWER		6			//	WakeMem, WakeMemFast, SleepMem
+#define STATF_COUNT		7
+
+typedef struct
+{
+	uint32_t	bytesRead;			//	Data bytes in (not command/address)
+	uint32_t	bytesWritten;		//	Data bytes out
+	uint16_t	commands[STAT_OPS];	//	Commands sent, by opcode
+	uint32_t	selects;			//	!CS low-high cycles
+	uint32_t	wipPolls;			//	Status polls in WaitWriteComplete()
+	uint32_t	waitUs;				//	Time spent waiting in between (approx., WIP_POLL_US each)
+	uint32_t	cacheHits;			//	CacheRead/CacheWrite pages found in the cache
+	uint32_t	cacheMisses;		//	... and not
+	uint16_t	failures[STATF_COUNT];	//	MEMFAIL returns, by function group
+} MemStats;
+
 //	Variables
+#if STATS_USED
+extern MemStats		MemStatsData[NUM_CHIPS];
+#define MEMSTAT( chip, field, n )	do { if( (unsigned short)(chip) < NUM_CHIPS ) MemStatsData[chip].field += (n); } while( 0 )
+#define MEMFAILED( chip, f )		MemStatFail( chip, f )
+#else
+#define MEMSTAT( chip, field, n )
+#define MEMFAILED( chip, f )		MEMFAIL
+#endif
 
 
 //	Functions
-short	ReadData( short chip, long Address, long NumBytes, short* data );
+short	ReadData( short chip, long Address, long NumBytes, short* data );		//	short-per-byte versions, kept for old callers
 short	WriteData( short chip, long Address, long NumBytes, short* data );
+short	ReadBytes( short chip, long Address, long NumBytes, uint8_t* data );		//	byte buffer versions - use these
+short	WriteBytes( short chip, long Address, long NumBytes, const uint8_t* data );
+short	WritePage( short chip, long Address, short NumBytes, const uint8_t* data );
+short	WriteDataIfChanged( short chip, long Address, long NumBytes, const uint8_t* data, short* programmed );
+short	WriteBytesVerify( short chip, long Address, long NumBytes, const uint8_t* data );
+short	CrcData( short chip, long Address, long NumBytes, uint16_t* crc );
+short	ReadDataStream( short chip, long Address, long NumBytes, MemSink sink, void* ctx );
+short	WriteDataStream( short chip, long Address, long NumBytes, MemSource source, void* ctx );
+short	ReadDataV( short chip, long Address, const MemVec* vec, short count );
+short	WriteDataV( short chip, long Address, const MemConstVec* vec, short count );
+short	BeginPageWrite( short chip, long Address );
+short	EndPageWrite( short chip );
 short	WriteEnable( short	chip );
 short	WriteDisable( short chip );
 short	ErasePage( short chip, long Address );
 short	EraseSector( short chip, long Address );
 short	EraseChip( short chip );
+short	FormatAll( void );
+short	EraseRange( short chip, long Address, long NumBytes );
+short	StartErase( short chip, uint8_t Command, long Address );
+short	ProtectLimit( short chip, long* limit );
 short	WakeMem( short chip );
 short	SleepMem( short chip );
+short	WakeMemFast( short chip );
+#if AUTOSLEEP_USED
+void	PowerTick( unsigned short ms );
+short	PowerWake( short chip );
+#endif
 short	ReadMemStatus( short chip, short* status );
 short	WriteMemStatus( short chip, short* status );
 short	GetCS( short chip );
 short	GetWP( short chip );
 short	InitMem( short chip );
+#if SCKCAL_USED
+short	CalibrateSck( short chip );
+#endif
+short	GetSckDivider( short chip );
 short	CheckProtect( short chip, long Address );
 short	SendCommandAndAddress( short chip, short Command, long Address );
 short	SendCommand( short chip, short Command );
 short	SendAddress( short chip, long Address );
 short	ReadByte( short* byte );
 short	SendByte( short byte );
+short	BeginCommand( short chip, uint8_t Command, MemPin* cs );
+short	EndCommand( const MemPin* cs );
+short	PumpRead( uint8_t* data, long NumBytes );
+short	PumpWrite( const uint8_t* data, long NumBytes );
+short	PumpCompare( const uint8_t* data, short NumBytes, short* first, short* last );
+short	PumpWriteCrc( const uint8_t* data, long NumBytes, uint16_t* crc );
+short	PumpReadCrc( long NumBytes, uint16_t* crc );
 short	SetCS( short chip );
 short	ClearCS( short chip );
 short	SetWP( short chip );
 short	ClearWP( short chip );
 short	CheckWIP( short chip );
+short	IsBusy( short chip );
+short	WaitWriteComplete( short chip, unsigned short timeout );
+short	WaitAllComplete( uint8_t mask, unsigned short timeout );
 int		GetPage( long Address, int* page );
+long	PageRemain( long Address );
+short	CheckRange( long Address, long NumBytes );
 int		Min( int num1, int num2 );		//  I thought this was a part of std C.  huh...
 void	CloseMem( short chip );
+#if HOLD_USED
+void	MemSetYield( MemYield fn, void* ctx );
+void	MemBusRequest( void );
+#endif
+#if STATS_USED
+short	GetMemStats( short chip, MemStats* stats );
+void	ClearMemStats( short chip );
+short	MemStatFail( short chip, short f );
+#endif
+void	ReaderOpen( MemReader* rd, short chip );
+short	ReaderRead( MemReader* rd, long Address, long NumBytes, uint8_t* data );
+short	ReaderClose( MemReader* rd );
+#if ASYNC_USED
+short	MemSubmit( MemRequest* req );
+short	AsyncBusy( void );
+#endif
 
 //	Macros
 #define _NOP() asm volatile ("nop" :: )		//  Needed for AVR
+#ifndef MEMPIN_HOOK
+#define MEMPIN_HOOK()						//	Runs after every !CS/!WP change.  The host simulator (sim/) uses it to see the edges.
+#endif
+
+
+/*************************************************************************
+Pin map
+
+CSPin()/WPPin() return the port/pin/DDR/mask for a chip's !CS or !WP.
+They're inline and built from the constants above, so when chip is a 
+constant the whole lookup folds away and SelectPin() ends up as a 
+plain cbi/sbic.  With a variable chip it is a small switch, once per 
+transaction.
+*************************************************************************/
+#define MEMPIN( PORT, PINR, DDR, BIT )	((MemPin){ &(PORT), &(PINR), &(DDR), (uint8_t)(1<<(BIT)) })
+
+static inline MemPin	CSPin( short chip )
+{
+	switch( chip )
+	{
+		case 1: return MEMPIN( CS1_PORT, CS1_PINR, CS1_DDR, CS1 );
+		case 2: return MEMPIN( CS2_PORT, CS2_PINR, CS2_DDR, CS2 );
+		case 3: return MEMPIN( CS3_PORT, CS3_PINR, CS3_DDR, CS3 );
+		default: return MEMPIN( CS0_PORT, CS0_PINR, CS0_DDR, CS0 );
+	}
+}
+
+static inline MemPin	WPPin( short chip )
+{
+	switch( chip )
+	{
+		case 1: return MEMPIN( WP1_PORT, WP1_PINR, WP1_DDR, WP1 );
+		case 2: return MEMPIN( WP2_PORT, WP2_PINR, WP2_DDR, WP2 );
+		case 3: return MEMPIN( WP3_PORT, WP3_PINR, WP3_DDR, WP3 );
+		default: return MEMPIN( WP0_PORT, WP0_PINR, WP0_DDR, WP0 );
+	}
+}
+
+/*************************************************************************
+Pulls a pin low / pushes it high, then reads it back to make sure it 
+took.  For !CS this readback is the only pin verification we do, so it
+happens exactly once at each end of a transaction.
+
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure
+*************************************************************************/
+static inline short	SelectPin( const MemPin* p )
+{
+	*p->port &= ~p->mask;
+	MEMPIN_HOOK();
+	
+	//  Wait a bit to ensure outputs are latched and settled
+	_NOP();
+	
+	if( *p->pin & p->mask )		//	Should be zero
+		return MEMFAIL;
+	
+	return MEMSUCC;
+}
+
+static inline short	DeselectPin( const MemPin* p )
+{
+	*p->port |= p->mask;
+	MEMPIN_HOOK();
+	
+	//  Wait a bit to ensure outputs are latched and settled
+	_NOP();
+	
+	if( !(*p->pin & p->mask) )	//	Should NOT be zero
+		return MEMFAIL;
+	
+	return MEMSUCC;
+}
 
 #endif /* 25AA1024_H_ */
\ No newline at end of file
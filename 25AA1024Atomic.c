@@ -0,0 +1,248 @@
+/*
+ * _25AA1024Atomic.c
+ *
+ * Torn-write safe page updates
+ */ 
+
+#include "25AA1024Atomic.h"
+#include "25AA1024Map.h"
+#include <util/crc16.h>
+#include <string.h>
+
+#if PAGEMAP_USED
+
+#define ATOM_ADDR(a, p)		((long)((a)->first + (p)) << 8)
+
+
+/*************************************************************************
+Checks the record in page p of the pool.  hdr gets its header.
+
+Returns
+	MEMTRUE		- a good record of this pool
+	MEMFALSE	- anything else (erased, torn, someone else's)
+	MEMFAIL		- couldn't read the memory
+*************************************************************************/
+static short	AtomCheck( MemAtomic* a, short p, uint8_t* hdr )
+{
+	long		addr = ATOM_ADDR( a, p );
+	uint16_t	crc;
+	uint16_t	saved;
+	
+	if( ReadBytes( a->chip, addr, ATOM_HDR, hdr ) )
+		return MEMFAIL;
+	
+	if( (hdr[0] != ATOM_MAGIC) || (hdr[1] != a->id) || (hdr[4] > ATOM_MAX_DATA) )
+		return MEMFALSE;
+	
+	if( CrcData( a->chip, addr, ATOM_HDR + hdr[4], &crc ) ||
+		ReadBytes( a->chip, addr + ATOM_HDR + hdr[4], 2, (uint8_t*)&saved ) )
+		return MEMFAIL;
+	
+	return (crc == saved) ? MEMTRUE : MEMFALSE;
+}
+
+/*************************************************************************
+Finds the current record of a pool.  Older records are marked stale in
+the page map.
+
+Inputs:
+	MemAtomic* a	- the pool
+	short chip	 - the chip it's on
+	short first	 - its first page
+	short pages	 - how many pages (2 or more)
+	uint8_t id	 - which pool this is
+	
+Returns
+	MEMSUCC	- on success (whether or not there's a record yet)
+	MEMFAIL	- bad pool, or the memory couldn't be read
+*************************************************************************/
+short	AtomOpen( MemAtomic* a, short chip, short first, short pages, uint8_t id )
+{
+	uint8_t		hdr[ATOM_HDR];
+	uint16_t	seq;
+	short		got;
+	short		p;
+	
+	if( (chip < 0) || (chip >= NUM_CHIPS) || (first < 0) || (pages < 2) ||
+		(first + pages > NUM_PAGES) )
+		return MEMFAIL;
+	
+	a->chip = chip;
+	a->first = first;
+	a->pages = pages;
+	a->cur = ATOM_NONE;
+	a->seq = 0;
+	a->len = 0;
+	a->id = id;
+	
+	for( p=0 ; p<pages ; p++ )
+	{
+		got = AtomCheck( a, p, hdr );
+		if( got == MEMFAIL )
+			return MEMFAIL;
+		if( got != MEMTRUE )
+			continue;
+		
+		MapSet( chip, first + p, 1, PG_VALID );
+		seq = hdr[2] | ((uint16_t)hdr[3] << 8);
+		
+		//	Newer (wrap safe)?
+		if( (a->cur == ATOM_NONE) || ((int16_t)(seq - a->seq) > 0) )
+		{
+			if( a->cur != ATOM_NONE )
+				MapSetStale( chip, first + a->cur );
+			a->cur = p;
+			a->seq = seq;
+			a->len = hdr[4];
+		}
+		else
+			MapSetStale( chip, first + p );
+	}
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Reads the current record
+
+Returns
+	short* len	- its length (at most max bytes are copied)
+	MEMTRUE		- got it
+	MEMFALSE	- there's no record yet
+	MEMFAIL		- couldn't read the memory
+*************************************************************************/
+short	AtomRead( MemAtomic* a, uint8_t* data, short max, short* len )
+{
+	if( a->cur == ATOM_NONE )
+		return MEMFALSE;
+	
+	*len = a->len;
+	
+	if( ReadBytes( a->chip, ATOM_ADDR( a, a->cur ) + ATOM_HDR, (a->len < max) ? a->len : max, data ) )
+		return MEMFAIL;
+	
+	return MEMTRUE;
+}
+
+/*************************************************************************
+Picks the page to try next, after page after:  the first erased one 
+going round (so the pages take turns), else just the next one.  Never 
+the current page.
+*************************************************************************/
+static short	AtomPick( MemAtomic* a, short after )
+{
+	short	p = after;
+	short	i;
+	
+	for( i=0 ; i<a->pages ; i++ )
+	{
+		if( ++p >= a->pages )
+			p = 0;
+		if( (p != a->cur) && (MapState( a->chip, a->first + p ) == PG_ERASED) )
+			return p;
+	}
+	
+	if( ++after >= a->pages )
+		after = 0;
+	if( after == a->cur )
+		if( ++after >= a->pages )
+			after = 0;
+	
+	return after;
+}
+
+/*************************************************************************
+Replaces the record (0..ATOM_MAX_DATA bytes).  The old record stays 
+current until the new one has been written and checked;  a page that 
+doesn't check out is erased (as far as it can be) and the next spare 
+tried.  Every try takes a new sequence number, so a failed page that 
+does hold good data can never tie with a later record.
+
+Returns
+	MEMSUCC	- the new record is current
+	MEMFAIL	- the old one still is (or none, if there wasn't one)
+*************************************************************************/
+short	AtomUpdate( MemAtomic* a, const uint8_t* data, short len )
+{
+	uint8_t		hdr[ATOM_HDR];
+	uint8_t		chk[ATOM_HDR];
+	uint16_t	crc;
+	MemConstVec	vec[3];
+	short		p;
+	short		i;
+	short		tries;
+	long		addr;
+	
+	if( (len < 0) || (len > ATOM_MAX_DATA) )
+		return MEMFAIL;
+	
+	hdr[0] = ATOM_MAGIC;
+	hdr[1] = a->id;
+	hdr[4] = (uint8_t)len;
+	
+	vec[0].ptr = hdr;
+	vec[0].len = ATOM_HDR;
+	vec[1].ptr = data;
+	vec[1].len = len;
+	vec[2].ptr = &crc;
+	vec[2].len = 2;
+	
+	p = (a->cur == ATOM_NONE) ? a->pages - 1 : a->cur;
+	
+	for( tries = (a->cur == ATOM_NONE) ? a->pages : a->pages - 1 ; tries > 0 ; tries-- )
+	{
+		p = AtomPick( a, p );
+		addr = ATOM_ADDR( a, p );
+		
+		if( MapState( a->chip, a->first + p ) != PG_ERASED )
+			if( ErasePage( a->chip, addr ) )
+				continue;
+		
+		//	Used up whether or not this try works
+		a->seq++;
+		hdr[2] = (uint8_t)a->seq;
+		hdr[3] = (uint8_t)(a->seq >> 8);
+		
+		crc = MEMCRC_INIT;
+		for( i=0 ; i<ATOM_HDR ; i++ )
+			crc = _crc_ccitt_update( crc, hdr[i] );
+		for( i=0 ; i<len ; i++ )
+			crc = _crc_ccitt_update( crc, data[i] );
+		
+		//	Checked the way AtomOpen() will see it - trailer and all
+		if( WriteDataV( a->chip, addr, vec, 3 ) || (AtomCheck( a, p, chk ) != MEMTRUE) ||
+			memcmp( chk, hdr, ATOM_HDR ) )
+		{
+			//	It may still read back good later - don't leave it there
+			(void)ErasePage( a->chip, addr );
+			continue;
+		}
+		
+		//	The new record is in:  the old one's dead
+		if( a->cur != ATOM_NONE )
+			MapSetStale( a->chip, a->first + a->cur );
+		
+		a->cur = p;
+		a->len = (uint8_t)len;
+		return MEMSUCC;
+	}
+	
+	return MEMFAIL;
+}
+
+/*************************************************************************
+Background work:  erases one spare page that isn't known to be erased,
+so the next update doesn't have to.  Call from an idle loop.
+*************************************************************************/
+short	AtomService( MemAtomic* a )
+{
+	short	p;
+	
+	for( p=0 ; p<a->pages ; p++ )
+		if( (p != a->cur) && (MapState( a->chip, a->first + p ) != PG_ERASED) )
+			return ErasePage( a->chip, ATOM_ADDR( a, p ) );
+	
+	return MEMSUCC;
+}
+
+#endif /* PAGEMAP_USED */
@@ -0,0 +1,67 @@
+/*
+ * _25AA1024Atomic.h
+ *
+ * Torn-write safe page updates
+ */ 
+
+/*************************************************************************
+Description:
+A small record (config, calibration...) that's always either the old 
+version or the new one, whenever the power goes.
+
+The record lives in a pool of two or more pages on one chip.  Each 
+update is written whole to a spare page of the pool - never over the 
+current one - as:
+
+	magic, id, seq (2), len, data (len), CRC-16 (2)
+
+then read back through CrcData() and checked.  The sequence number is 
+the pointer:  the record with the highest seq and a good CRC is the 
+current one, so the flip happens the moment the new page is complete.
+A write that's cut short fails its CRC and the old record stands.  An 
+update costs one page program and one readback;  no second copy.
+
+The page map (PAGEMAP_USED in 25AA1024.h) says which spare pages are 
+already erased, so an update can skip the erase.  Superseded pages are
+marked stale, and AtomService() erases them from an idle loop, ready 
+for the next update.  With nothing erased, AtomUpdate() erases the 
+spare itself (MTWC more).
+
+id tells pools apart, so a page left behind by some other pool (or 
+some other use) isn't taken for a record.
+
+NOTE:  Needs PAGEMAP_USED.
+NOTE:  After a restart the map doesn't know the spare pages are erased
+	until AtomService() (or MapScan()) has been over them.
+*************************************************************************/
+#include "25AA1024.h"
+
+
+#ifndef _25AA1024ATOMIC_H_
+#define _25AA1024ATOMIC_H_
+
+#define ATOM_MAGIC			0xA5
+#define ATOM_HDR			5			//	magic, id, seq (2), len
+#define ATOM_OVERHEAD		(ATOM_HDR + 2)
+#define ATOM_MAX_DATA		(PAGE_SIZE - ATOM_OVERHEAD)	//	Biggest record
+#define ATOM_NONE			(-1)		//	cur of an empty pool
+
+typedef struct
+{
+	short		chip;
+	short		first;					//	First page of the pool
+	short		pages;					//	Number of pages (at least 2)
+	short		cur;					//	Page holding the current record (0..pages-1, or ATOM_NONE)
+	uint16_t	seq;					//	Last sequence number used (its, or a failed try's since)
+	uint8_t		len;					//	Its length
+	uint8_t		id;
+} MemAtomic;
+
+
+//	Functions
+short	AtomOpen( MemAtomic* a, short chip, short first, short pages, uint8_t id );
+short	AtomRead( MemAtomic* a, uint8_t* data, short max, short* len );
+short	AtomUpdate( MemAtomic* a, const uint8_t* data, short len );
+short	AtomService( MemAtomic* a );
+
+#endif /* _25AA1024ATOMIC_H_ */
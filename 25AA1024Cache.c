@@ -0,0 +1,258 @@
+/*
+ * _25AA1024Cache.c
+ *
+ * Write-behind page cache
+ */ 
+
+#include "25AA1024Cache.h"
+#include <string.h>
+
+#if CACHE_PAGES
+
+#if CACHE_PAGES > 2
+#error "CACHE_PAGES must be 0, 1 or 2"
+#endif
+
+#define NO_PAGE		(-1)
+
+typedef struct
+{
+	short	chip;
+	short	page;				//	NO_PAGE if the slot is empty
+	uint8_t	dirty;				//	MEMTRUE if [lo, hi] needs writing back
+	uint8_t	lo;					//	First dirty byte in the page
+	uint8_t	hi;					//	Last dirty byte in the page
+	uint8_t	data[PAGE_SIZE];
+} CachePage;
+
+static CachePage	Cache[CACHE_PAGES] = 
+{
+	{ 0, NO_PAGE, MEMFALSE, 0, 0, { 0 } },
+#if CACHE_PAGES > 1
+	{ 0, NO_PAGE, MEMFALSE, 0, 0, { 0 } },
+#endif
+};
+
+static uint8_t		CacheMRU;	//	Slot used most recently
+
+
+/*************************************************************************
+Returns the slot holding (chip, page), or 0 if it isn't cached
+*************************************************************************/
+static CachePage*	CacheFind( short chip, short page )
+{
+	uint8_t	i;
+	
+	for( i=0 ; i<CACHE_PAGES ; i++ )
+		if( (Cache[i].page == page) && (Cache[i].chip == chip) )
+		{
+			CacheMRU = i;
+			return &Cache[i];
+		}
+	
+	return 0;
+}
+
+/*************************************************************************
+Writes the dirty part of a slot back to the chip, and waits for it.  The
+chip may still be busy with something else (WritePage, StartErase, an 
+async write...) - a WREN then would be ignored and the data lost, so 
+wait for that first.
+*************************************************************************/
+static short	CacheWriteBack( CachePage* slot )
+{
+	long	Address;
+	
+	if( !slot->dirty )
+		return MEMSUCC;
+	
+	Address = (long)slot->page * PAGE_SIZE + slot->lo;
+
+	if( WaitWriteComplete( slot->chip, MTCE ) )
+		return MEMFAIL;
+	
+	if( WritePage( slot->chip, Address, (short)(slot->hi - slot->lo) + 1, &slot->data[slot->lo] ) )
+		return MEMFAIL;
+	
+	if( WaitWriteComplete( slot->chip, MTWC ) )
+		return MEMFAIL;
+	
+	slot->dirty = MEMFALSE;
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Gets a slot for (chip, page), evicting the least recently used page if
+need be.  The page is read in from the chip unless the caller is about
+to overwrite all of it.
+*************************************************************************/
+static CachePage*	CacheLoad( short chip, short page, short whole )
+{
+	CachePage*	slot;
+	
+	slot = CacheFind( chip, page );
+	if( slot )
+	{
+		MEMSTAT( chip, cacheHits, 1 );
+		return slot;
+	}
+	
+	MEMSTAT( chip, cacheMisses, 1 );
+	CacheMRU = (CacheMRU + 1) % CACHE_PAGES;
+	slot = &Cache[CacheMRU];
+	
+	if( CacheWriteBack( slot ) )
+		return 0;
+	
+	slot->page = NO_PAGE;
+	
+	//	A READ during a write cycle gets FFh - which would then be cached,
+	//		and written back over the real data
+	if( !whole )
+		if( WaitWriteComplete( chip, MTCE ) ||
+			ReadBytes( chip, (long)page * PAGE_SIZE, PAGE_SIZE, slot->data ) )
+			return 0;
+	
+	slot->chip = chip;
+	slot->page = page;
+	
+	return slot;
+}
+
+/*************************************************************************
+Reads through the cache
+
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure
+*************************************************************************/
+short	CacheRead( short chip, long Address, long NumBytes, uint8_t* data )
+{
+	CachePage*	slot;
+	long		chunk;
+	
+	if( CheckRange( Address, NumBytes ) )
+		return MEMFAIL;
+	
+	while( NumBytes > 0 )
+	{
+		chunk = PageRemain( Address );
+		if( chunk > NumBytes )
+			chunk = NumBytes;
+		
+		slot = CacheFind( chip, (short)(Address / PAGE_SIZE) );
+		
+		if( slot )
+			MEMSTAT( chip, cacheHits, 1 );
+		else
+			MEMSTAT( chip, cacheMisses, 1 );
+		
+		if( slot )
+			memcpy( data, &slot->data[Address & (PAGE_SIZE - 1)], chunk );
+		else if( WaitWriteComplete( chip, MTCE ) || ReadBytes( chip, Address, chunk, data ) )
+			return MEMFAIL;
+		
+		Address += chunk;
+		data += chunk;
+		NumBytes -= chunk;
+	}
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Writes into the cache.  Nothing goes to the chip until the page is 
+evicted or flushed.
+
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure (an eviction write-back or page load failed)
+*************************************************************************/
+short	CacheWrite( short chip, long Address, long NumBytes, const uint8_t* data )
+{
+	CachePage*	slot;
+	long		chunk;
+	uint8_t		offset;
+	
+	if( CheckRange( Address, NumBytes ) )
+		return MEMFAIL;
+	
+	while( NumBytes > 0 )
+	{
+		chunk = PageRemain( Address );
+		if( chunk > NumBytes )
+			chunk = NumBytes;
+		
+		slot = CacheLoad( chip, (short)(Address / PAGE_SIZE), (chunk == PAGE_SIZE) );
+		if( !slot )
+			return MEMFAIL;
+		
+		offset = (uint8_t)(Address & (PAGE_SIZE - 1));
+		memcpy( &slot->data[offset], data, chunk );
+		
+		//	Grow the dirty span to cover this write
+		if( !slot->dirty )
+		{
+			slot->lo = offset;
+			slot->hi = (uint8_t)(offset + chunk - 1);
+			slot->dirty = MEMTRUE;
+		}
+		else
+		{
+			if( offset < slot->lo )
+				slot->lo = offset;
+			if( (uint8_t)(offset + chunk - 1) > slot->hi )
+				slot->hi = (uint8_t)(offset + chunk - 1);
+		}
+		
+		Address += chunk;
+		data += chunk;
+		NumBytes -= chunk;
+	}
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Writes back everything cached for one chip (or all of them)
+*************************************************************************/
+short	CacheFlush( short chip )
+{
+	uint8_t	i;
+	
+	for( i=0 ; i<CACHE_PAGES ; i++ )
+		if( (Cache[i].page != NO_PAGE) && (Cache[i].chip == chip) )
+			if( CacheWriteBack( &Cache[i] ) )
+				return MEMFAIL;
+	
+	return MEMSUCC;
+}
+
+short	CacheFlushAll( void )
+{
+	uint8_t	i;
+	
+	for( i=0 ; i<CACHE_PAGES ; i++ )
+		if( Cache[i].page != NO_PAGE )
+			if( CacheWriteBack( &Cache[i] ) )
+				return MEMFAIL;
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Drops everything in the cache WITHOUT writing it back
+*************************************************************************/
+void	CacheInvalidate( void )
+{
+	uint8_t	i;
+	
+	for( i=0 ; i<CACHE_PAGES ; i++ )
+	{
+		Cache[i].page = NO_PAGE;
+		Cache[i].dirty = MEMFALSE;
+	}
+}
+
+#endif
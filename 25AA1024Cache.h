@@ -0,0 +1,39 @@
+/*
+ * _25AA1024Cache.h
+ *
+ * Write-behind page cache
+ */ 
+
+/*************************************************************************
+Description:
+Small writes that land in the same page are collected in a RAM copy of
+the page and programmed in one go, instead of costing a write cycle 
+each.  CACHE_PAGES (in 25AA1024.h) pages are kept - 1 or 2.
+
+A cached page is written back:
+	- when its slot is needed for another page
+	- on CacheFlush() / CacheFlushAll()
+	- from SleepMem()
+Only the span of the page that was actually touched is programmed.
+
+Reads through CacheRead() see the cached data.  Reads that miss go 
+straight to the chip and are not cached.
+
+NOTE:  Don't mix CacheWrite() with direct writes (WriteBytes, etc.) to 
+	the same page without a CacheFlush() in between - the direct write 
+	will be overwritten when the cache is written back.
+*************************************************************************/
+#include "25AA1024.h"
+
+
+#ifndef _25AA1024CACHE_H_
+#define _25AA1024CACHE_H_
+
+//	Functions
+short	CacheRead( short chip, long Address, long NumBytes, uint8_t* data );
+short	CacheWrite( short chip, long Address, long NumBytes, const uint8_t* data );
+short	CacheFlush( short chip );
+short	CacheFlushAll( void );
+void	CacheInvalidate( void );
+
+#endif /* _25AA1024CACHE_H_ */
@@ -0,0 +1,241 @@
+/*
+ * _25AA1024KV.c
+ *
+ * Key-value store on top of the log
+ */ 
+
+#include "25AA1024KV.h"
+
+
+/*************************************************************************
+Replays the log into the index - oldest first, so newer records win
+*************************************************************************/
+static short	KVRebuild( MemKV* kv )
+{
+	LogCursor	cur;
+	uint8_t		key;
+	short		len;
+	long		where;
+	short		got;
+	short		i;
+	
+	for( i=0 ; i<KV_KEYS ; i++ )
+		kv->addr[i] = KV_NONE;
+	
+	LogFirst( &kv->log, &cur );
+	
+	while( (got = LogNext( &kv->log, &cur, &key, 1, &len, &where )) == MEMTRUE )
+	{
+		if( key >= KV_KEYS )
+			continue;
+		
+		if( len > 1 )
+		{
+			kv->addr[key] = where;
+			kv->len[key] = (uint8_t)(len - 1);
+		}
+		else
+			kv->addr[key] = KV_NONE;		//	Deleted
+	}
+	
+	return (got == MEMFALSE) ? MEMSUCC : MEMFAIL;
+}
+
+/*************************************************************************
+Mounts the store in volume pages [first, first + pages) and rebuilds 
+the index.  KVFormat() wipes it first.
+*************************************************************************/
+short	KVInit( MemKV* kv, long first, short pages )
+{
+	long	base;
+	short	k;
+	
+	if( LogMount( &kv->log, first, pages ) )
+		return MEMFAIL;
+	
+	if( KVRebuild( kv ) )
+		return MEMFAIL;
+	
+	//	Pages compaction let go of still look like log pages until the 
+	//		erase-ahead gets to them.  Drop them again - they're the ones
+	//		at the tail with nothing current in them.
+	while( kv->log.tail != kv->log.head )
+	{
+		base = LogPageAddr( &kv->log, kv->log.tail );
+		
+		for( k=0 ; k<KV_KEYS ; k++ )
+			if( (kv->addr[k] >= base) && (kv->addr[k] < base + PAGE_SIZE) )
+				break;
+		
+		if( k < KV_KEYS )
+			break;
+		
+		LogDropTail( &kv->log );
+	}
+	
+	return MEMSUCC;
+}
+
+short	KVFormat( MemKV* kv, long first, short pages )
+{
+	if( LogFormat( &kv->log, first, pages ) )
+		return MEMFAIL;
+	
+	return KVRebuild( kv );
+}
+
+/*************************************************************************
+Compacts the oldest page:  live records get copied to the head, then 
+the page is dropped.
+
+Returns
+	MEMSUCC	- a page was freed
+	MEMFALSE	- nothing to compact (the log is a single page)
+	MEMFAIL	- couldn't read/write
+*************************************************************************/
+static short	KVCompact( MemKV* kv )
+{
+	LogCursor	cur;
+	short		tail;
+	uint8_t		key;
+	short		len;
+	long		where;
+	short		got;
+	
+	tail = kv->log.tail;
+	if( tail == kv->log.head )
+		return MEMFALSE;
+	
+	//	Copying a page's worth may start a new head page - which must not
+	//	be the one we're copying from.  KV_RESERVE keeps this from happening.
+	if( LogFreePages( &kv->log ) < 1 )
+		return MEMFAIL;
+	
+	cur.page = tail;
+	cur.off = LOG_HDR;
+	
+	while( (got = LogNext( &kv->log, &cur, &key, 1, &len, &where )) == MEMTRUE )
+	{
+		if( cur.page != tail )
+			break;
+		
+		//	Still the newest copy?  Move it.
+		if( (key < KV_KEYS) && (kv->addr[key] == where) )
+			if( LogCopy( &kv->log, where, &kv->addr[key] ) )
+				return MEMFAIL;
+	}
+	
+	if( got == MEMFAIL )
+		return MEMFAIL;
+	
+	LogDropTail( &kv->log );
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Makes sure there are at least `want` free pages, compacting as needed
+*************************************************************************/
+static short	KVMakeRoom( MemKV* kv, short want )
+{
+	short	tries;
+	short	err;
+	
+	for( tries=0 ; LogFreePages( &kv->log ) < want ; tries++ )
+	{
+		//	Been all the way round and it's still full - it's live data
+		if( tries >= kv->log.pages )
+			return MEMFAIL;
+		
+		err = KVCompact( kv );
+		if( err != MEMSUCC )
+			return MEMFAIL;
+	}
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Looks a key up
+
+Returns
+	short* len	- length of the value (at most max bytes are copied)
+	MEMTRUE		- found
+	MEMFALSE	- no such key
+	MEMFAIL		- couldn't read the memory
+*************************************************************************/
+short	KVGet( MemKV* kv, uint8_t key, uint8_t* data, short max, short* len )
+{
+	if( (key >= KV_KEYS) || (kv->addr[key] == KV_NONE) )
+		return MEMFALSE;
+	
+	*len = kv->len[key];
+	
+	//	Skip the length byte and the key
+	if( LogReadAt( &kv->log, kv->addr[key] + 2, data, (*len < max) ? *len : max ) )
+		return MEMFAIL;
+	
+	return MEMTRUE;
+}
+
+/*************************************************************************
+Sets a key's value (1..KV_MAX_VALUE bytes)
+*************************************************************************/
+short	KVPut( MemKV* kv, uint8_t key, const uint8_t* data, short len )
+{
+	long	where;
+	
+	if( (key >= KV_KEYS) || (len < 1) || (len > KV_MAX_VALUE) )
+		return MEMFAIL;
+	
+	if( KVMakeRoom( kv, KV_RESERVE ) )
+		return MEMFAIL;
+	
+	if( LogAppendParts( &kv->log, &key, 1, data, len, &where ) )
+		return MEMFAIL;
+	
+	kv->addr[key] = where;
+	kv->len[key] = (uint8_t)len;
+	
+	return MEMSUCC;
+}
+
+short	KVDelete( MemKV* kv, uint8_t key )
+{
+	if( key >= KV_KEYS )
+		return MEMFAIL;
+	
+	if( kv->addr[key] == KV_NONE )
+		return MEMSUCC;
+	
+	if( KVMakeRoom( kv, KV_RESERVE ) )
+		return MEMFAIL;
+	
+	if( LogAppend( &kv->log, &key, 1, 0 ) )
+		return MEMFAIL;
+	
+	kv->addr[key] = KV_NONE;
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Makes everything put so far durable
+*************************************************************************/
+short	KVFlush( MemKV* kv )
+{
+	return LogFlush( &kv->log );
+}
+
+/*************************************************************************
+Background work:  compacts one page if free space is getting low, and 
+keeps the erase-ahead going.  Call from an idle loop.
+*************************************************************************/
+short	KVService( MemKV* kv )
+{
+	if( LogFreePages( &kv->log ) < KV_COMPACT_AT )
+		if( KVCompact( kv ) == MEMFAIL )
+			return MEMFAIL;
+	
+	return LogService( &kv->log );
+}
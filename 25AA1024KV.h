@@ -0,0 +1,64 @@
+/*
+ * _25AA1024KV.h
+ *
+ * Key-value store on top of the log
+ */ 
+
+/*************************************************************************
+Description:
+Small parameters by key (0..KV_KEYS-1) instead of at fixed addresses.
+
+Every update is just a new record appended to a log (25AA1024Log.h):
+one byte of key, then the value.  A record with no value deletes the 
+key.  So updates cost a small append rather than a read-modify-write of
+a whole page, and since the log goes round and round the whole region, 
+the writes are spread evenly over its pages rather than hammering the 
+same few.
+
+A RAM index (key -> address and length of its newest record) is rebuilt
+by replaying the log in KVInit(), so a lookup is an index hit plus one
+short read.
+
+Compaction keeps the log from running over live data:  records in the
+oldest page that are still current get copied to the head, and the page 
+is let go (it's erased by the log's erase-ahead when the head gets 
+there).  KVPut() compacts when it has to;  KVService() does it ahead of
+time from an idle loop.
+
+RAM:  sizeof(MemLog) (one page buffer + change) + 5 bytes per key.
+
+NOTE:  The live data has to fit in (pages - LOG_ERASE_AHEAD - KV_RESERVE)
+	pages, or KVPut() starts failing.
+*************************************************************************/
+#include "25AA1024Log.h"
+
+
+#ifndef _25AA1024KV_H_
+#define _25AA1024KV_H_
+
+#ifndef KV_KEYS
+#define KV_KEYS				32			//	Number of keys
+#endif
+#define KV_RESERVE			2			//	Free pages KVPut() keeps in hand (compacts below this)
+#define KV_COMPACT_AT		4			//	KVService() starts compacting below this many free pages
+#define KV_MAX_VALUE		(LOG_MAX_RECORD - 1)	//	Biggest value
+#define KV_NONE				(-1L)		//	Index entry of a key with no value
+
+typedef struct
+{
+	MemLog		log;
+	long		addr[KV_KEYS];			//	Address of each key's newest record (KV_NONE if none)
+	uint8_t		len[KV_KEYS];			//	Length of its value
+} MemKV;
+
+
+//	Functions
+short	KVInit( MemKV* kv, long first, short pages );
+short	KVFormat( MemKV* kv, long first, short pages );
+short	KVGet( MemKV* kv, uint8_t key, uint8_t* data, short max, short* len );
+short	KVPut( MemKV* kv, uint8_t key, const uint8_t* data, short len );
+short	KVDelete( MemKV* kv, uint8_t key );
+short	KVFlush( MemKV* kv );
+short	KVService( MemKV* kv );
+
+#endif /* _25AA1024KV_H_ */
@@ -0,0 +1,697 @@
+/*
+ * _25AA1024Log.c
+ *
+ * Append-only circular log on top of the volume layer
+ */ 
+
+#include "25AA1024Log.h"
+#include <string.h>
+
+
+/*************************************************************************
+Volume address of log page `page`
+*************************************************************************/
+long	LogPageAddr( MemLog* log, short page )
+{
+	return (log->first + page) * PAGE_SIZE;
+}
+
+/*************************************************************************
+Reads a page's sequence number (LOG_NO_SEQ if it's erased)
+*************************************************************************/
+static short	LogReadSeq( MemLog* log, short page, uint32_t* seq )
+{
+	uint8_t	hdr[4];
+	
+	if( VolRead( LogPageAddr( log, page ), 4, hdr ) )
+		return MEMFAIL;
+	
+	*seq = (uint32_t)hdr[0] | ((uint32_t)hdr[1] << 8) | ((uint32_t)hdr[2] << 16) | ((uint32_t)hdr[3] << 24);
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Delta page decoding, a byte at a time so it can run off the chip in small
+chunks as easily as off a page buffer
+*************************************************************************/
+typedef struct
+{
+	uint32_t	acc;			//	Varint so far
+	uint8_t		shift;
+	uint8_t		have;			//	MEMTRUE once the base is in
+	int16_t		value;			//	Last sample decoded
+} LogDelta;
+
+static void	LogDeltaStart( LogDelta* d )
+{
+	d->acc = 0;
+	d->shift = 0;
+	d->have = MEMFALSE;
+	d->value = 0;
+}
+
+//	Returns MEMTRUE when b finishes a sample (it's in d->value)
+static short	LogDeltaByte( LogDelta* d, uint8_t b )
+{
+	uint16_t	z;
+	
+	d->acc |= (uint32_t)(b & 0x7F) << d->shift;
+	
+	if( b & 0x80 )
+	{
+		d->shift += 7;
+		if( d->shift > 14 )
+		{
+			d->acc = 0;			//	Too long - erased space, not data
+			d->shift = 0;
+		}
+		return MEMFALSE;
+	}
+	
+	z = (uint16_t)d->acc;
+	d->acc = 0;
+	d->shift = 0;
+	
+	//	Un-zigzag, then add to the previous sample (mod 2^16, as encoded)
+	z = (z >> 1) ^ (uint16_t)-(int16_t)(z & 1);
+	d->value = d->have ? (int16_t)(uint16_t)((uint16_t)d->value + z) : (int16_t)z;
+	d->have = MEMTRUE;
+	
+	return MEMTRUE;
+}
+
+/*************************************************************************
+Starts a fresh head page in RAM
+*************************************************************************/
+static void	LogStartPage( MemLog* log )
+{
+	memset( log->buf, LOG_END, PAGE_SIZE );
+	
+	log->buf[0] = (uint8_t)log->seq;
+	log->buf[1] = (uint8_t)(log->seq >> 8);
+	log->buf[2] = (uint8_t)(log->seq >> 16);
+	log->buf[3] = (uint8_t)(log->seq >> 24);
+	log->buf[4] = LOG_PAGE_RECORDS;
+	
+	log->fill = LOG_HDR;
+	log->flushed = 0;
+}
+
+/*************************************************************************
+The erase-ahead eats the oldest pages;  keep tail pointing at real data
+*************************************************************************/
+static void	LogTrimTail( MemLog* log )
+{
+	short	d;
+	
+	d = log->tail - log->head;
+	if( d < 0 )
+		d += log->pages;
+	
+	if( (d != 0) && (d <= LOG_ERASE_AHEAD) )
+		log->tail = (log->head + LOG_ERASE_AHEAD + 1) % log->pages;
+}
+
+/*************************************************************************
+Programs whatever of the head page isn't on the chip yet.  If the page
+is done, the rest of it goes out too (as 0xFF) so the writer ends up at
+the start of the next page.
+*************************************************************************/
+static short	LogWriteOut( MemLog* log, short upto )
+{
+	if( upto <= log->flushed )
+		return MEMSUCC;
+	
+	if( VolSeqWrite( &log->w, upto - log->flushed, &log->buf[log->flushed] ) )
+		return MEMFAIL;
+	
+	log->flushed = upto;
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Closes out the head page and moves on to the next one
+*************************************************************************/
+static short	LogNextPage( MemLog* log )
+{
+	if( LogWriteOut( log, PAGE_SIZE ) )
+		return MEMFAIL;
+	
+	log->head = (log->head + 1) % log->pages;
+	log->seq++;
+	
+	//	Skip the erased-page marker if the counter ever gets there
+	if( log->seq == LOG_NO_SEQ )
+		log->seq = 0;
+	
+	LogStartPage( log );
+	LogTrimTail( log );
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Makes the head page a `type` page, starting a new one if it already has 
+something else in it (or its type byte is already on the chip)
+*************************************************************************/
+static short	LogWantType( MemLog* log, uint8_t type )
+{
+	if( log->buf[4] == type )
+		return MEMSUCC;
+	
+	if( (log->fill > LOG_HDR) || (log->flushed > 4) )
+		if( LogNextPage( log ) )
+			return MEMFAIL;
+	
+	log->buf[4] = type;
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Erases the log's pages and mounts it (empty)
+
+Inputs:
+	long first	- first volume page
+	short pages	- number of pages (more than LOG_ERASE_AHEAD + 1)
+*************************************************************************/
+short	LogFormat( MemLog* log, long first, short pages )
+{
+	short	i;
+	short	chip;
+	long	PhysAddr;
+	
+	for( i=0 ; i<pages ; i++ )
+	{
+		if( VolMap( (first + i) * PAGE_SIZE, &chip, &PhysAddr ) )
+			return MEMFAIL;
+		
+		//	Only waits for this chip - erases on the others keep going
+		if( WaitWriteComplete( chip, VOL_TIMEOUT ) || StartErase( chip, MPE, PhysAddr ) )
+			return MEMFAIL;
+	}
+	
+	if( VolFlush() )
+		return MEMFAIL;
+	
+	return LogMount( log, first, pages );
+}
+
+/*************************************************************************
+Finds the head of an existing log (or sets up an empty one)
+
+The newest page is the last page whose sequence number is at or after
+page 0's (in wrapping, serial number terms) - everything after it is 
+either erased or left over from the previous time around.  That is a
+sorted predicate over the pages, so it's a binary search.
+
+Page 0 may be erased even in a full log, if the head recently wrapped 
+and the erase-ahead got there.  The gap is never more than the head 
+page plus LOG_ERASE_AHEAD, so the search just starts from the first 
+written page past it instead.
+*************************************************************************/
+short	LogMount( MemLog* log, long first, short pages )
+{
+	uint32_t	seq0;
+	uint32_t	seq;
+	short		r;
+	short		lo;
+	short		hi;
+	short		mid;
+	short		off;
+	short		i;
+	long		pos;
+	LogDelta	d;
+	
+	if( pages <= (LOG_ERASE_AHEAD + 1) )
+		return MEMFAIL;
+	
+	if( ((first + pages) * PAGE_SIZE) > VOLSIZE )
+		return MEMFAIL;
+	
+	log->first = first;
+	log->pages = pages;
+	
+	//	First written page, looking past a possible erase-ahead gap
+	seq0 = LOG_NO_SEQ;
+	
+	for( r=0 ; r<=(LOG_ERASE_AHEAD + 1) ; r++ )
+	{
+		if( LogReadSeq( log, r, &seq0 ) )
+			return MEMFAIL;
+		
+		if( seq0 != LOG_NO_SEQ )
+			break;
+	}
+	
+	if( seq0 == LOG_NO_SEQ )
+	{
+		//	Empty log
+		log->head = 0;
+		log->tail = 0;
+		log->seq = 0;
+		LogStartPage( log );
+	}
+	else
+	{
+		//	Binary search for the last page with seq >= seq0
+		lo = r;					//	Known good
+		hi = pages - 1;
+		
+		while( lo < hi )
+		{
+			mid = (lo + hi + 1) / 2;
+			
+			if( LogReadSeq( log, mid, &seq ) )
+				return MEMFAIL;
+			
+			if( (seq != LOG_NO_SEQ) && ((uint32_t)(seq - seq0) < 0x80000000UL) )
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+		
+		log->head = lo;
+		
+		//	Pull the head page in and walk its records to find the end
+		if( VolRead( LogPageAddr( log, lo ), PAGE_SIZE, log->buf ) )
+			return MEMFAIL;
+		
+		log->seq = (uint32_t)log->buf[0] | ((uint32_t)log->buf[1] << 8) | 
+					((uint32_t)log->buf[2] << 16) | ((uint32_t)log->buf[3] << 24);
+		
+		if( log->buf[4] == LOG_PAGE_DELTA )
+		{
+			//	The end is just past the last complete sample
+			LogDeltaStart( &d );
+			off = LOG_HDR;
+			for( i=LOG_HDR ; i<PAGE_SIZE ; i++ )
+				if( LogDeltaByte( &d, log->buf[i] ) )
+				{
+					off = i + 1;
+					log->last = d.value;
+				}
+		}
+		else
+		{
+			off = LOG_HDR;
+			while( (off < PAGE_SIZE) && (log->buf[off] != LOG_END) )
+				off += 1 + log->buf[off];
+			
+			if( off > PAGE_SIZE )
+				off = PAGE_SIZE;		//	Torn last record - don't append into it
+		}
+		
+		log->fill = off;
+		log->flushed = off;
+		
+		//	Oldest page:  the first written page past the erase-ahead gap,
+		//		or page 0 if there's nothing there (we haven't been around yet)
+		log->tail = 0;
+		
+		for( i=1 ; i<=(LOG_ERASE_AHEAD + 2) ; i++ )
+		{
+			mid = (lo + i) % pages;
+			
+			if( LogReadSeq( log, mid, &seq ) )
+				return MEMFAIL;
+			
+			if( seq != LOG_NO_SEQ )
+			{
+				log->tail = mid;
+				break;
+			}
+		}
+	}
+	
+	//	Hook the writer up where the head page leaves off
+	pos = LogPageAddr( log, log->head ) + log->flushed;
+	if( pos >= LogPageAddr( log, pages ) )
+		pos = LogPageAddr( log, 0 );
+	
+	return VolSeqOpen( &log->w, LogPageAddr( log, 0 ), LogPageAddr( log, pages ), pos, LOG_ERASE_AHEAD );
+}
+
+/*************************************************************************
+Appends a record
+
+Inputs:
+	const uint8_t* data	- the record
+	short len			- its length (1..LOG_MAX_RECORD)
+	
+Returns
+	long* where	- (may be 0) volume address of the record's length byte
+	MEMSUCC	- on success
+	MEMFAIL	- on failure
+*************************************************************************/
+short	LogAppend( MemLog* log, const uint8_t* data, short len, long* where )
+{
+	return LogAppendParts( log, data, len, 0, 0, where );
+}
+
+/*************************************************************************
+Appends one record made of two pieces (e.g. a key and a value), without
+the caller having to glue them together first.  b may be 0 if blen is.
+*************************************************************************/
+short	LogAppendParts( MemLog* log, const uint8_t* a, short alen, const uint8_t* b, short blen, long* where )
+{
+	short	len = alen + blen;
+	
+	if( (len < 1) || (len > LOG_MAX_RECORD) )
+		return MEMFAIL;
+	
+	if( LogWantType( log, LOG_PAGE_RECORDS ) )
+		return MEMFAIL;
+	
+	if( (log->fill + 1 + len) > PAGE_SIZE )
+		if( LogNextPage( log ) )
+			return MEMFAIL;
+	
+	if( where )
+		*where = LogPageAddr( log, log->head ) + log->fill;
+	
+	log->buf[log->fill] = (uint8_t)len;
+	memcpy( &log->buf[log->fill + 1], a, alen );
+	if( blen )
+		memcpy( &log->buf[log->fill + 1 + alen], b, blen );
+	log->fill += 1 + len;
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Re-appends an existing record (at volume address from) by copying it 
+straight from the chip into the head page - no buffer needed.  Used for
+compaction.
+*************************************************************************/
+short	LogCopy( MemLog* log, long from, long* where )
+{
+	uint8_t	len;
+	
+	if( LogReadAt( log, from, &len, 1 ) )
+		return MEMFAIL;
+	
+	if( (len < 1) || (len > LOG_MAX_RECORD) )
+		return MEMFAIL;
+	
+	if( LogWantType( log, LOG_PAGE_RECORDS ) )
+		return MEMFAIL;
+	
+	if( (log->fill + 1 + len) > PAGE_SIZE )
+		if( LogNextPage( log ) )
+			return MEMFAIL;
+	
+	if( LogReadAt( log, from + 1, &log->buf[log->fill + 1], len ) )
+		return MEMFAIL;
+	
+	if( where )
+		*where = LogPageAddr( log, log->head ) + log->fill;
+	
+	log->buf[log->fill] = len;
+	log->fill += 1 + len;
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Pages that can still be filled before the writer starts eating the 
+oldest data (tail) - NOT counting the head page or the erase-ahead
+*************************************************************************/
+short	LogFreePages( MemLog* log )
+{
+	short	used;
+	
+	used = log->head - log->tail;
+	if( used < 0 )
+		used += log->pages;
+	
+	return log->pages - (used + 1) - LOG_ERASE_AHEAD;
+}
+
+/*************************************************************************
+Gives up the oldest page (tail).  Its space gets reused when the head 
+comes around to it.
+*************************************************************************/
+void	LogDropTail( MemLog* log )
+{
+	if( log->tail != log->head )
+		log->tail = (log->tail + 1) % log->pages;
+}
+
+/*************************************************************************
+Puts everything appended so far on the chip (and waits for it)
+*************************************************************************/
+short	LogFlush( MemLog* log )
+{
+	if( LogWriteOut( log, log->fill ) )
+		return MEMFAIL;
+	
+	return VolFlush();
+}
+
+/*************************************************************************
+Keeps the erase-ahead going - call from an idle loop
+*************************************************************************/
+short	LogService( MemLog* log )
+{
+	return VolSeqService( &log->w );
+}
+
+/*************************************************************************
+Reads from the log's pages, including what's still only in RAM
+*************************************************************************/
+short	LogReadAt( MemLog* log, long Address, uint8_t* data, short NumBytes )
+{
+	long	head = LogPageAddr( log, log->head );
+	
+	if( (Address >= head) && ((Address + NumBytes) <= (head + PAGE_SIZE)) )
+	{
+		memcpy( data, &log->buf[Address - head], NumBytes );
+		return MEMSUCC;
+	}
+	
+	return VolRead( Address, NumBytes, data );
+}
+
+/*************************************************************************
+Record iteration:  LogFirst() points the cursor at the oldest record,
+LogNext() reads one record and moves on.
+
+LogNext() returns
+	MEMTRUE		- got a record (*len is its real length;  at most max 
+					bytes of it are copied to data)
+	MEMFALSE	- no more records
+	MEMFAIL		- couldn't read the memory
+*************************************************************************/
+short	LogFirst( MemLog* log, LogCursor* cur )
+{
+	cur->page = log->tail;
+	cur->off = LOG_HDR;
+	
+	return MEMSUCC;
+}
+
+short	LogNext( MemLog* log, LogCursor* cur, uint8_t* data, short max, short* len, long* where )
+{
+	uint8_t	hdr[LOG_HDR];
+	uint8_t	n;
+	long	Address;
+	
+	for( ;; )
+	{
+		Address = LogPageAddr( log, cur->page ) + cur->off;
+		
+		//	Only record pages hold records
+		if( cur->off == LOG_HDR )
+		{
+			if( cur->page == log->head )
+			{
+				if( log->buf[4] != LOG_PAGE_RECORDS )
+					return MEMFALSE;
+			}
+			else
+			{
+				if( LogReadAt( log, LogPageAddr( log, cur->page ), hdr, LOG_HDR ) )
+					return MEMFAIL;
+				if( hdr[4] != LOG_PAGE_RECORDS )
+					cur->off = PAGE_SIZE;
+			}
+		}
+		
+		if( cur->page == log->head )
+		{
+			if( cur->off >= log->fill )
+				return MEMFALSE;
+			n = log->buf[cur->off];
+		}
+		else if( cur->off >= PAGE_SIZE )
+			n = LOG_END;
+		else if( LogReadAt( log, Address, &n, 1 ) )
+			return MEMFAIL;
+		
+		//	End of this page (or garbage) - on to the next
+		if( (n == LOG_END) || ((cur->off + 1 + n) > PAGE_SIZE) )
+		{
+			if( cur->page == log->head )
+				return MEMFALSE;
+			
+			cur->page = (cur->page + 1) % log->pages;
+			cur->off = LOG_HDR;
+			
+			continue;
+		}
+		
+		*len = n;
+		if( where )
+			*where = Address;
+		
+		if( LogReadAt( log, Address + 1, data, (n < max) ? n : max ) )
+			return MEMFAIL;
+		
+		cur->off += 1 + n;
+		
+		return MEMTRUE;
+	}
+}
+
+/*************************************************************************
+Appends a 16 bit sample to a delta page (see 25AA1024Log.h).  Costs 1-3
+bytes, depending on how far it is from the one before.
+*************************************************************************/
+short	LogAppendSample( MemLog* log, int16_t value )
+{
+	uint8_t		enc[3];
+	short		n;
+	uint16_t	z;
+	int16_t		delta;
+	
+	if( LogWantType( log, LOG_PAGE_DELTA ) )
+		return MEMFAIL;
+	
+	for( ;; )
+	{
+		//	First sample in the page is the base
+		delta = (log->fill == LOG_HDR) ? value : (int16_t)(uint16_t)((uint16_t)value - (uint16_t)log->last);
+		
+		z = ((uint16_t)delta << 1) ^ (uint16_t)(delta >> 15);
+		for( n=0 ; z >= 0x80 ; n++ )
+		{
+			enc[n] = (uint8_t)(z | 0x80);
+			z >>= 7;
+		}
+		enc[n++] = (uint8_t)z;
+		
+		if( (log->fill + n) <= PAGE_SIZE )
+			break;
+		
+		//	Doesn't fit - new page, new base
+		if( LogNextPage( log ) )
+			return MEMFAIL;
+		log->buf[4] = LOG_PAGE_DELTA;
+	}
+	
+	memcpy( &log->buf[log->fill], enc, n );
+	log->fill += n;
+	log->last = value;
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Decodes one delta page (all PAGE_SIZE bytes of it, header included).
+
+Returns
+	short* count	- samples in the page (at most max are stored to out)
+	MEMSUCC	- on success
+	MEMFAIL	- not a delta page
+*************************************************************************/
+short	LogDecodePage( const uint8_t* page, int16_t* out, short max, short* count )
+{
+	LogDelta	d;
+	short		i;
+	
+	*count = 0;
+	
+	if( page[4] != LOG_PAGE_DELTA )
+		return MEMFAIL;
+	
+	LogDeltaStart( &d );
+	
+	for( i=LOG_HDR ; i<PAGE_SIZE ; i++ )
+		if( LogDeltaByte( &d, page[i] ) )
+		{
+			if( *count < max )
+				out[*count] = d.value;
+			(*count)++;
+		}
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Sample iteration:  LogFirst(), then LogNextSamples() decodes the next 
+delta page after the cursor into out and moves on to the page after it.
+Pages of records are skipped.  Reads the chip in small pieces, so it 
+doesn't need a page of RAM.
+
+Returns
+	short* count	- samples in the page (at most max are stored to out)
+	MEMTRUE		- decoded a page
+	MEMFALSE	- no more delta pages
+	MEMFAIL		- couldn't read the memory
+*************************************************************************/
+short	LogNextSamples( MemLog* log, LogCursor* cur, int16_t* out, short max, short* count )
+{
+	uint8_t		chunk[16];
+	LogDelta	d;
+	long		Address;
+	short		end;
+	short		off;
+	short		i;
+	
+	*count = 0;
+	
+	for( ;; )
+	{
+		//	Done with this page?
+		if( cur->off >= PAGE_SIZE )
+		{
+			if( cur->page == log->head )
+				return MEMFALSE;
+			
+			cur->page = (cur->page + 1) % log->pages;
+			cur->off = LOG_HDR;
+		}
+		
+		Address = LogPageAddr( log, cur->page );
+		end = (cur->page == log->head) ? log->fill : PAGE_SIZE;
+		
+		if( LogReadAt( log, Address, chunk, LOG_HDR ) )
+			return MEMFAIL;
+		
+		cur->off = PAGE_SIZE;
+		
+		if( chunk[4] == LOG_PAGE_DELTA )
+			break;
+	}
+	
+	LogDeltaStart( &d );
+	
+	for( off=LOG_HDR ; off<end ; off+=sizeof(chunk) )
+	{
+		if( LogReadAt( log, Address + off, chunk, (end - off < (short)sizeof(chunk)) ? end - off : (short)sizeof(chunk) ) )
+			return MEMFAIL;
+		
+		for( i=0 ; (i < (short)sizeof(chunk)) && (off + i < end) ; i++ )
+			if( LogDeltaByte( &d, chunk[i] ) )
+			{
+				if( *count < max )
+					out[*count] = d.value;
+				(*count)++;
+			}
+	}
+	
+	return MEMTRUE;
+}
\ No newline at end of file
@@ -0,0 +1,100 @@
+/*
+ * _25AA1024Log.h
+ *
+ * Append-only circular log on top of the volume layer
+ */ 
+
+/*************************************************************************
+Description:
+A circular record log over a range of volume pages.  Every page starts
+with a small header:
+
+	bytes 0-3	sequence number (little endian), one higher per page
+	byte  4		page type (LOG_PAGE_RECORDS or LOG_PAGE_DELTA)
+
+A LOG_PAGE_RECORDS page holds records, each a length byte and then that
+many bytes of data.  An erased length byte (0xFF) marks the end of the 
+page.
+
+A LOG_PAGE_DELTA page holds 16 bit samples (LogAppendSample), packed:
+the first is stored as it is, every one after as the difference from 
+the one before, each zigzag encoded (small negatives stay small) and 
+written as a varint (7 bits per byte, high bit = more to come).  A 
+slowly moving sensor value costs 1 byte a sample instead of 2, or 3 
+for a length-prefixed record.  Each page starts from a fresh base, so 
+any page decodes on its own (LogDecodePage).  The last byte of a varint
+never has its high bit set, so the erased (0xFF) tail of the page can't
+be mistaken for data.
+
+Records and samples can be mixed in one log;  switching from one to the
+other starts a new page.
+
+Mounting doesn't scan the log.  Since the sequence numbers only go up
+as the log goes around, the newest page can be found by binary search
+over the page headers - 9 header reads for 512 pages - followed by one 
+page read to find the end of the last record.
+
+Appends go into a RAM copy of the current page, and the page is 
+programmed once, when it fills up (or on LogFlush()).  Pages are kept 
+erased ahead of the writer (LOG_ERASE_AHEAD pages, see VolSeqWrite), 
+which means the oldest data goes a little before the log is strictly 
+full.
+
+NOTE:  Records not yet flushed are lost on power failure.  LogFlush() 
+	after anything you can't afford to lose.
+*************************************************************************/
+#include "25AA1024Vol.h"
+
+
+#ifndef _25AA1024LOG_H_
+#define _25AA1024LOG_H_
+
+#define LOG_HDR				5			//	Page header size
+#define LOG_PAGE_RECORDS	0x01		//	Page type:  length-prefixed records
+#define LOG_PAGE_DELTA		0x02		//	Page type:  delta + varint packed samples
+#define LOG_MAX_SAMPLES		(PAGE_SIZE - LOG_HDR)	//	Most samples a page can hold
+#define LOG_END				0xFF		//	Length byte of erased space
+#define LOG_MAX_RECORD		(PAGE_SIZE - LOG_HDR - 1)	//	Biggest record that fits in a page
+#define LOG_ERASE_AHEAD		2			//	Pages kept erased ahead of the head
+#define LOG_NO_SEQ			0xFFFFFFFFUL	//	Sequence number of an erased page
+
+typedef struct
+{
+	long			first;		//	First volume page of the log
+	short			pages;		//	Number of pages
+	short			head;		//	Page being filled (0..pages-1)
+	short			tail;		//	Oldest page still holding data
+	uint32_t		seq;		//	Sequence number of the head page
+	short			fill;		//	Bytes used in the head page (header included)
+	short			flushed;	//	Bytes of the head page already on the chip
+	int16_t			last;		//	Last sample in the head page (LOG_PAGE_DELTA)
+	VolSeqWriter	w;
+	uint8_t			buf[PAGE_SIZE];		//	The head page
+} MemLog;
+
+typedef struct
+{
+	short	page;				//	Page being read
+	short	off;				//	Next record's offset in that page
+} LogCursor;
+
+
+//	Functions
+short	LogFormat( MemLog* log, long first, short pages );
+short	LogMount( MemLog* log, long first, short pages );
+short	LogAppend( MemLog* log, const uint8_t* data, short len, long* where );
+short	LogAppendParts( MemLog* log, const uint8_t* a, short alen, const uint8_t* b, short blen, long* where );
+short	LogCopy( MemLog* log, long from, long* where );
+short	LogFreePages( MemLog* log );
+void	LogDropTail( MemLog* log );
+short	LogFlush( MemLog* log );
+short	LogService( MemLog* log );
+short	LogFirst( MemLog* log, LogCursor* cur );
+short	LogNext( MemLog* log, LogCursor* cur, uint8_t* data, short max, short* len, long* where );
+short	LogReadAt( MemLog* log, long Address, uint8_t* data, short NumBytes );
+short	LogAppendSample( MemLog* log, int16_t value );
+short	LogNextSamples( MemLog* log, LogCursor* cur, int16_t* out, short max, short* count );
+short	LogDecodePage( const uint8_t* page, int16_t* out, short max, short* count );
+long	LogPageAddr( MemLog* log, short page );
+
+#endif /* _25AA1024LOG_H_ */
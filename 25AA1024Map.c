@@ -0,0 +1,250 @@
+/*
+ * _25AA1024Map.c
+ *
+ * In-RAM page state map
+ */ 
+
+#include "25AA1024Map.h"
+#include <string.h>
+
+#if PAGEMAP_USED
+
+#if PAGEMAP_USED > 2
+#error "PAGEMAP_USED must be 0, 1 or 2"
+#endif
+
+//	Bit planes.  State = Lo | (Hi << 1), so PG_ERASED is Lo only - and in
+//		the 1 bit map, Lo is all there is.
+static uint8_t	MapLo[NUM_CHIPS][MAP_BYTES];
+#if PAGEMAP_USED == 2
+static uint8_t	MapHi[NUM_CHIPS][MAP_BYTES];
+#endif
+
+#define PAGE_OF(a)	((short)(((a) >> 8) & (NUM_PAGES - 1)))
+
+/*************************************************************************
+Forgets everything about a chip (all pages unknown)
+*************************************************************************/
+void	MapClear( short chip )
+{
+	if( (chip < 0) || (chip >= NUM_CHIPS) )
+		return;
+	
+	memset( MapLo[chip], 0, MAP_BYTES );
+#if PAGEMAP_USED == 2
+	memset( MapHi[chip], 0, MAP_BYTES );
+#endif
+}
+
+/*************************************************************************
+Returns the state of a page (PG_xxx).  In the 1 bit map, anything not 
+known to be erased comes back as PG_UNKNOWN.
+*************************************************************************/
+short	MapState( short chip, short page )
+{
+	uint8_t	bit = 1 << (page & 7);
+	short	state;
+	
+	if( (chip < 0) || (chip >= NUM_CHIPS) || (page < 0) || (page >= NUM_PAGES) )
+		return PG_UNKNOWN;
+	
+	state = (MapLo[chip][page >> 3] & bit) ? 1 : 0;
+#if PAGEMAP_USED == 2
+	if( MapHi[chip][page >> 3] & bit )
+		state |= 2;
+#endif
+	
+	return state;
+}
+
+/*************************************************************************
+Sets pages [first, first+count) of a chip to state.  Whole bytes of the
+map are filled in one go.
+*************************************************************************/
+void	MapSet( short chip, short first, short count, short state )
+{
+	short	end = first + count;
+	uint8_t	lo = (state & 1) ? 0xFF : 0x00;
+#if PAGEMAP_USED == 2
+	uint8_t	hi = (state & 2) ? 0xFF : 0x00;
+#endif
+	uint8_t	bit;
+	
+	if( (chip < 0) || (chip >= NUM_CHIPS) )
+		return;
+	
+	while( first < end )
+	{
+		//	Byte aligned and a whole byte to go?
+		if( !(first & 7) && ((end - first) >= 8) )
+		{
+			MapLo[chip][first >> 3] = lo;
+#if PAGEMAP_USED == 2
+			MapHi[chip][first >> 3] = hi;
+#endif
+			first += 8;
+			continue;
+		}
+		
+		bit = 1 << (first & 7);
+		MapLo[chip][first >> 3] = (MapLo[chip][first >> 3] & ~bit) | (lo & bit);
+#if PAGEMAP_USED == 2
+		MapHi[chip][first >> 3] = (MapHi[chip][first >> 3] & ~bit) | (hi & bit);
+#endif
+		first++;
+	}
+}
+
+/*************************************************************************
+Marks a valid page's data as dead.  Does nothing to pages in any other 
+state, or with the 1 bit map.
+*************************************************************************/
+void	MapSetStale( short chip, short page )
+{
+#if PAGEMAP_USED == 2
+	if( MapState( chip, page ) == PG_VALID )
+		MapSet( chip, page, 1, PG_STALE );
+#endif
+}
+
+/*************************************************************************
+Mask of the pages in map byte i that are in state
+*************************************************************************/
+static inline uint8_t	MapMatch( short chip, short i, short state )
+{
+	uint8_t	m;
+	
+	m = (state & 1) ? MapLo[chip][i] : ~MapLo[chip][i];
+#if PAGEMAP_USED == 2
+	m &= (state & 2) ? MapHi[chip][i] : ~MapHi[chip][i];
+#else
+	if( state & 2 )
+		m = 0;
+#endif
+	
+	return m;
+}
+
+/*************************************************************************
+Finds the first page at or after from that is in state.  Eight pages 
+are checked at a time - bytes with no match are skipped whole.
+
+Returns
+	the page, or MAP_NONE if there isn't one
+*************************************************************************/
+short	MapFind( short chip, short from, short state )
+{
+	short	i;
+	uint8_t	m;
+	
+	if( (chip < 0) || (chip >= NUM_CHIPS) || (from < 0) )
+		return MAP_NONE;
+	
+	for( i = from >> 3 ; i < MAP_BYTES ; i++ )
+	{
+		m = MapMatch( chip, i, state );
+		
+		//	Ignore pages before from in the first byte
+		if( i == (from >> 3) )
+			m &= 0xFF << (from & 7);
+		
+		if( m )
+		{
+			from = i << 3;
+			while( !(m & 1) )
+			{
+				m >>= 1;
+				from++;
+			}
+			return from;
+		}
+	}
+	
+	return MAP_NONE;
+}
+
+short	MapFindErased( short chip, short from )
+{
+	return MapFind( chip, from, PG_ERASED );
+}
+
+/*************************************************************************
+Counts the pages of a chip in state
+*************************************************************************/
+short	MapCount( short chip, short state )
+{
+	short	count = 0;
+	short	i;
+	uint8_t	m;
+	
+	if( (chip < 0) || (chip >= NUM_CHIPS) )
+		return 0;
+	
+	for( i=0 ; i<MAP_BYTES ; i++ )
+		for( m = MapMatch( chip, i, state ) ; m ; m &= m - 1 )
+			count++;
+	
+	return count;
+}
+
+/*************************************************************************
+Builds the map for a chip by reading every page:  all FFh is erased, 
+anything else valid.  Takes one sequential read of the chip (~128K bytes
+on the bus), so it's for start-up, not the hot path.
+*************************************************************************/
+short	MapScan( short chip )
+{
+	MemReader	rd;
+	uint8_t		buf[16];
+	uint8_t		all;
+	short		page;
+	short		i, j;
+	
+	ReaderOpen( &rd, chip );
+	
+	for( page=0 ; page<NUM_PAGES ; page++ )
+	{
+		all = 0xFF;
+		
+		for( i=0 ; i<PAGE_SIZE ; i+=sizeof(buf) )
+		{
+			if( ReaderRead( &rd, ((long)page << 8) + i, sizeof(buf), buf ) )
+			{
+				ReaderClose( &rd );
+				return MEMFAIL;
+			}
+			for( j=0 ; j<(short)sizeof(buf) ; j++ )
+				all &= buf[j];
+		}
+		
+		MapSet( chip, page, 1, (all == 0xFF) ? PG_ERASED : PG_VALID );
+	}
+	
+	return ReaderClose( &rd );
+}
+
+/*************************************************************************
+Driver hook:  a write to Address has been started
+*************************************************************************/
+void	MapWritten( short chip, long Address )
+{
+	MapSet( chip, PAGE_OF( Address ), 1, PG_VALID );
+}
+
+/*************************************************************************
+Driver hook:  an erase (MPE, MSE or MCE) has been started.  Taken as 
+done:  the chip silently ignores protected erases, but checking the BP
+bits here would cost an RDSR on every erase - the callers that can hit
+protected pages check first (see StartErase).
+*************************************************************************/
+void	MapErased( short chip, uint8_t Command, long Address )
+{
+	if( Command == MCE )
+		MapSet( chip, 0, NUM_PAGES, PG_ERASED );
+	else if( Command == MSE )
+		MapSet( chip, PAGE_OF( Address & ~(SECTOR_SIZE - 1) ), SECTOR_SIZE / PAGE_SIZE, PG_ERASED );
+	else
+		MapSet( chip, PAGE_OF( Address ), 1, PG_ERASED );
+}
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ * _25AA1024Map.h
+ *
+ * In-RAM page state map
+ */ 
+
+/*************************************************************************
+Description:
+Keeps track of which pages are erased (and, optionally, which hold live
+or stale data) so the layers above know where they can write without
+reading the chip first.
+
+PAGEMAP_USED (in 25AA1024.h) picks the flavour:
+	1 - one bit per page:  erased or not.  64 bytes per chip.
+	2 - two bits per page:  unknown / erased / valid / stale.  
+		128 bytes per chip.
+
+The map is kept up to date by the driver itself:  every page write 
+(BeginPageWrite, MemSubmit) marks its page valid, and every erase 
+(StartErase, so ErasePage etc. too) marks its pages erased.  Erases 
+aren't checked against the BP bits here - ErasePage, EraseSector, 
+EraseChip, EraseRange, VolErase and QueueRun refuse protected ones, and
+the log / sequential writer regions have to be unprotected anyway.  Stale is only ever set by the caller (MapSetStale), 
+since only it knows when data is dead.
+
+Everything starts out unknown (which in the 1 bit map reads as "not 
+erased").  MapScan() reads a chip through to find its erased pages, 
+or just erase what you're going to use.
+
+NOTE:  The map only knows about what goes through this driver.  The
+	state is lost when the power goes.
+*************************************************************************/
+#include "25AA1024.h"
+
+
+#ifndef _25AA1024MAP_H_
+#define _25AA1024MAP_H_
+
+//	Page states
+#define PG_UNKNOWN		0			//	Never seen (or written over while unknown)
+#define PG_ERASED		1			//	All FFh
+#define PG_VALID		2			//	Has been written
+#define PG_STALE		3			//	Written, but the data's dead (PAGEMAP_USED 2 only)
+
+#define MAP_BYTES		(NUM_PAGES / 8)		//	Bytes per chip per bit plane
+#define MAP_NONE		(-1)		//	MapFind() found nothing
+
+//	Functions
+void	MapClear( short chip );
+short	MapState( short chip, short page );
+void	MapSet( short chip, short first, short count, short state );
+void	MapSetStale( short chip, short page );
+short	MapFind( short chip, short from, short state );
+short	MapFindErased( short chip, short from );
+short	MapCount( short chip, short state );
+short	MapScan( short chip );
+
+//	Driver hooks
+void	MapWritten( short chip, long Address );
+void	MapErased( short chip, uint8_t Command, long Address );
+
+#endif /* _25AA1024MAP_H_ */
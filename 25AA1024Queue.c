@@ -0,0 +1,199 @@
+/*
+ * _25AA1024Queue.c
+ *
+ * Batched transactions
+ */ 
+
+#include "25AA1024Queue.h"
+#include <util/delay.h>
+
+
+/*************************************************************************
+Returns the first unfinished op for chip, or 0 if it has none
+*************************************************************************/
+static MemOp*	QueueHead( MemOp* ops, short count, short chip )
+{
+	short	i;
+	
+	for( i=0 ; i<count ; i++ )
+		if( (ops[i].chip == chip) && (ops[i].status == QPENDING) )
+			return &ops[i];
+	
+	return 0;
+}
+
+/*************************************************************************
+Does the next bit of an op:  a whole read or status read, a single 
+page of a write, or the start of an erase.  Writes and erases are NOT
+waited for - the chip just shows up busy on the next pass.
+*************************************************************************/
+static void	QueueStep( MemOp* op, MemReader* rd )
+{
+	long	chunk;
+	short	status;
+	
+	switch( op->op )
+	{
+		case QOP_READ:
+			//	The reader keeps the READ open, so a contiguous read next 
+			//		costs no command/address
+			if( rd->chip != op->chip )
+			{
+				ReaderClose( rd );
+				ReaderOpen( rd, op->chip );
+			}
+			op->status = ReaderRead( rd, op->Address, op->NumBytes, op->data );
+			break;
+		
+		case QOP_WRITE:
+			chunk = PageRemain( op->Address + op->done );
+			if( chunk > (op->NumBytes - op->done) )
+				chunk = op->NumBytes - op->done;
+			
+			if( WritePage( op->chip, op->Address + op->done, (short)chunk, &op->data[op->done] ) )
+			{
+				op->status = MEMFAIL;
+				break;
+			}
+			
+			op->done += chunk;
+			if( op->done >= op->NumBytes )
+				op->status = MEMSUCC;
+			break;
+		
+		case QOP_ERASE:
+			//	The chip ignores a PE on a protected page - don't call that success
+			if( CheckProtect( op->chip, op->Address ) != MEMFALSE )
+				op->status = MEMFAIL;
+			else
+				op->status = StartErase( op->chip, MPE, op->Address );
+			break;
+		
+		case QOP_STATUS:
+			op->status = ReadMemStatus( op->chip, &status );
+			op->data[0] = (uint8_t)status;
+			break;
+		
+		default:
+			op->status = MEMFAIL;
+			break;
+	}
+}
+
+/*************************************************************************
+Runs a batch of ops (see 25AA1024Queue.h)
+
+Inputs:
+	MemOp* ops		- the ops.  status is filled in for each.
+	short count		- how many
+	
+Returns
+	MEMSUCC	- every op succeeded
+	MEMFAIL	- at least one failed (or a chip never came back from busy)
+*************************************************************************/
+short	QueueRun( MemOp* ops, short count )
+{
+	MemReader		rd;
+	MemOp*			op;
+	uint8_t			dirty[NUM_CHIPS];	//	MEMTRUE if the chip may be in a write cycle
+	short			chip;
+	short			busy;
+	short			issued;
+	unsigned long	idle = 0;		//	Polls in a row with nothing to do
+	short			err = MEMSUCC;
+	short			i;
+	
+	for( i=0 ; i<count ; i++ )
+	{
+		ops[i].done = 0;
+		
+		if( (ops[i].NumBytes < 0) || CheckRange( ops[i].Address, (ops[i].op == QOP_WRITE) ? ops[i].NumBytes : 0 ) )
+			ops[i].status = MEMFAIL;
+		else if( (ops[i].chip < 0) || (ops[i].chip >= NUM_CHIPS) )
+			ops[i].status = MEMFAIL;
+		else
+			ops[i].status = QPENDING;
+	}
+	
+	//	Not known to be idle until asked
+	for( chip=0 ; chip<NUM_CHIPS ; chip++ )
+		dirty[chip] = MEMTRUE;
+	
+	ReaderOpen( &rd, 0 );
+	
+	for( ;; )
+	{
+		issued = MEMFALSE;
+		
+		for( chip=0 ; chip<NUM_CHIPS ; chip++ )
+		{
+			op = QueueHead( ops, count, chip );
+			if( !op )
+				continue;
+			
+			//	Still burning last time's write/erase?  Somebody else's turn.
+			//		Only asked after a write/erase:  the RDSR would close 
+			//		the reader's READ, and a chip we left idle still is.
+			if( dirty[chip] )
+			{
+				busy = IsBusy( chip );
+				if( busy == MEMTRUE )
+					continue;
+				if( busy == MEMFAIL )
+				{
+					op->status = MEMFAIL;
+					continue;
+				}
+				dirty[chip] = MEMFALSE;
+			}
+			
+			if( (op->op == QOP_WRITE) || (op->op == QOP_ERASE) )
+				dirty[chip] = MEMTRUE;
+			
+			QueueStep( op, &rd );
+			issued = MEMTRUE;
+			
+			//	Just did a read and the next op here is a read too?  Do it now, 
+			//		while the READ is still open - contiguous ones merge.
+			while( (op->op == QOP_READ) && (op = QueueHead( ops, count, chip )) && (op->op == QOP_READ) )
+				QueueStep( op, &rd );
+		}
+		
+		if( issued )
+		{
+			idle = 0;
+			continue;
+		}
+		
+		//	Nothing issued:  either we're done, or everyone is busy
+		for( chip=0 ; chip<NUM_CHIPS ; chip++ )
+			if( QueueHead( ops, count, chip ) )
+				break;
+		
+		if( chip == NUM_CHIPS )
+			break;
+		
+		if( ++idle > ((unsigned long)MTCE * 1000) / WIP_POLL_US )
+		{
+			for( i=0 ; i<count ; i++ )
+				if( ops[i].status == QPENDING )
+					ops[i].status = MEMFAIL;
+			break;
+		}
+		
+		_delay_us( WIP_POLL_US );
+	}
+	
+	ReaderClose( &rd );
+	
+	//	Let the last writes/erases finish
+	for( chip=0 ; chip<NUM_CHIPS ; chip++ )
+		if( WaitWriteComplete( chip, MTCE ) )
+			err = MEMFAIL;
+	
+	for( i=0 ; i<count ; i++ )
+		if( ops[i].status != MEMSUCC )
+			err = MEMFAIL;
+	
+	return err;
+}
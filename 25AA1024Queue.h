@@ -0,0 +1,57 @@
+/*
+ * _25AA1024Queue.h
+ *
+ * Batched transactions
+ */ 
+
+/*************************************************************************
+Description:
+Hand QueueRun() a list of reads/writes/erases/status reads and it runs
+them all, in whatever order gets them done fastest:
+	- ops on DIFFERENT chips are interleaved, so one chip's write or
+		erase cycle runs while another chip is being read or written.
+		A write is issued a page at a time, and the queue moves on to 
+		other chips while that page burns.
+	- ops on the SAME chip always run in the order given, so a 
+		read after a write to the same chip sees the new data.
+	- back-to-back reads on the same chip are done as one READ when
+		they're contiguous (no command/address for the second) - as 
+		long as nothing else goes out on the bus in between.  A chip
+		is only polled for busy after it's been given a write or 
+		erase, so reads on an idle chip don't break the READ up.
+
+Everything is finished (all write cycles included) when QueueRun() 
+returns.  Each op's status says how it went.
+
+NOTE:  ops on different chips are assumed to be independent.
+*************************************************************************/
+#include "25AA1024.h"
+
+
+#ifndef _25AA1024QUEUE_H_
+#define _25AA1024QUEUE_H_
+
+//	Operations
+#define QOP_READ		0		//	Read NumBytes at Address into data
+#define QOP_WRITE		1		//	Write NumBytes from data to Address (any length)
+#define QOP_ERASE		2		//	Erase the page containing Address
+#define QOP_STATUS		3		//	Read the status register into data[0]
+
+#define QPENDING		(-1)	//	MemOp.status while the op hasn't finished
+
+typedef struct
+{
+	uint8_t		op;				//	QOP_xxx
+	short		chip;
+	long		Address;
+	long		NumBytes;
+	uint8_t*	data;
+	short		status;			//	Out:  MEMSUCC/MEMFAIL
+	long		done;			//	Internal:  bytes finished so far
+} MemOp;
+
+
+//	Functions
+short	QueueRun( MemOp* ops, short count );
+
+#endif /* _25AA1024QUEUE_H_ */
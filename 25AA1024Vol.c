@@ -0,0 +1,484 @@
+/*
+ * _25AA1024Vol.c
+ *
+ * Logical volume:  up to NUM_CHIPS 25AA1024s as one address space
+ */ 
+
+#include "25AA1024Vol.h"
+#include <util/delay.h>
+
+
+static short	VolMode = VOL_LINEAR;
+
+
+/*************************************************************************
+Initializes every chip in the volume and picks the layout
+
+Inputs:
+	short mode	- VOL_LINEAR or VOL_STRIPED
+	
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure
+*************************************************************************/
+short	VolInit( short mode )
+{
+	short	chip;
+	
+	if( (mode != VOL_LINEAR) && (mode != VOL_STRIPED) )
+		return MEMFAIL;
+	
+	VolMode = mode;
+	
+	for( chip=0 ; chip<NUM_CHIPS ; chip++ )
+		if( InitMem( chip ) )
+			return MEMFAIL;
+	
+	return MEMSUCC;
+}
+
+void	VolClose( void )
+{
+	short	chip;
+	
+	for( chip=0 ; chip<NUM_CHIPS ; chip++ )
+		CloseMem( chip );
+}
+
+long	VolSize( void )
+{
+	return VOLSIZE;
+}
+
+/*************************************************************************
+Translates a volume address into chip + address on that chip
+
+Inputs:
+	long Address	- volume address
+	
+Returns
+	short* chip		- the chip it lives on
+	long* PhysAddr	- address on that chip
+	MEMSUCC	- on success
+	MEMFAIL	- Address is off the end of the volume
+*************************************************************************/
+short	VolMap( long Address, short* chip, long* PhysAddr )
+{
+	long	page;
+	
+	if( (Address < 0) || (Address >= VOLSIZE) )
+		return MEMFAIL;
+	
+	if( VolMode == VOL_STRIPED )
+	{
+		page = Address / PAGE_SIZE;
+		*chip = (short)(page % NUM_CHIPS);
+		*PhysAddr = (page / NUM_CHIPS) * PAGE_SIZE + (Address & (PAGE_SIZE - 1));
+	}
+	else
+	{
+		*chip = (short)(Address / (MEMSIZE + 1));
+		*PhysAddr = Address & MEMSIZE;
+	}
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Returns how many bytes starting at Address are contiguous on one chip
+*************************************************************************/
+static long	VolSpan( long Address )
+{
+	if( (VolMode == VOL_STRIPED) && (NUM_CHIPS > 1) )
+		return PageRemain( Address );
+	
+	return (MEMSIZE + 1) - (Address & MEMSIZE);
+}
+
+/*************************************************************************
+Reads from the volume.  Waits for each chip to finish any write cycle
+before reading from it.
+*************************************************************************/
+short	VolRead( long Address, long NumBytes, uint8_t* data )
+{
+	short	chip;
+	long	PhysAddr;
+	long	chunk;
+	
+	if( (NumBytes < 0) || (Address + NumBytes > VOLSIZE) )
+		return MEMFAIL;
+	
+	while( NumBytes > 0 )
+	{
+		if( VolMap( Address, &chip, &PhysAddr ) )
+			return MEMFAIL;
+		
+		chunk = VolSpan( Address );
+		if( chunk > NumBytes )
+			chunk = NumBytes;
+		
+		if( WaitWriteComplete( chip, VOL_TIMEOUT ) )
+			return MEMFAIL;
+		
+		if( ReadBytes( chip, PhysAddr, chunk, data ) )
+			return MEMFAIL;
+		
+		Address += chunk;
+		data += chunk;
+		NumBytes -= chunk;
+	}
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Writes to the volume, one page program per (partial) page.  Each page 
+only waits for its own chip to be idle, so in VOL_STRIPED mode the write 
+cycles of consecutive pages overlap across chips.
+
+NOTE:  Returns with the last write cycle(s) still running (see VolFlush)
+*************************************************************************/
+short	VolWrite( long Address, long NumBytes, const uint8_t* data )
+{
+	short	chip;
+	long	PhysAddr;
+	long	chunk;
+	
+	if( (NumBytes < 0) || (Address + NumBytes > VOLSIZE) )
+		return MEMFAIL;
+	
+	while( NumBytes > 0 )
+	{
+		if( VolMap( Address, &chip, &PhysAddr ) )
+			return MEMFAIL;
+		
+		chunk = PageRemain( Address );
+		if( chunk > NumBytes )
+			chunk = NumBytes;
+		
+		//	Only this chip has to be done - the others keep burning
+		if( WaitWriteComplete( chip, VOL_TIMEOUT ) )
+			return MEMFAIL;
+		
+		if( WritePage( chip, PhysAddr, (short)chunk, data ) )
+			return MEMFAIL;
+		
+		Address += chunk;
+		data += chunk;
+		NumBytes -= chunk;
+	}
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Waits for every chip in the volume to finish its write cycle
+*************************************************************************/
+short	VolFlush( void )
+{
+	short	chip;
+	
+	for( chip=0 ; chip<NUM_CHIPS ; chip++ )
+		if( WaitWriteComplete( chip, VOL_TIMEOUT ) )
+			return MEMFAIL;
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Erases [Address, Address+NumBytes) of the volume, with every chip it 
+touches erasing at the same time:  each chip's share is worked out up 
+front, then whichever chip goes idle gets its next erase (CE for a whole
+chip, SE for whole sectors, PE for the rest).  So erasing across 4 chips
+takes about as long as the biggest single share.
+
+Block protected pages are skipped, as in EraseRange() - and as there, a
+range that's all protected fails.
+
+Inputs:
+	long Address - start of the range.  Must be page aligned.
+	long NumBytes - length of the range.  Must be a multiple of PAGE_SIZE.
+	
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- on failure, a range that isn't page aligned, or a range 
+		that's all block protected
+*************************************************************************/
+short	VolErase( long Address, long NumBytes )
+{
+	long			lo[NUM_CHIPS];		//	Each chip's share, physical [lo, hi)
+	long			hi[NUM_CHIPS];
+	long			first;				//	First / last+1 logical page
+	long			last;
+	long			limit;
+	unsigned long	polls;
+	uint8_t			mask = 0;			//	Chips with erasing still to start
+	uint8_t			started;
+	short			busy;
+	short			chip;
+	
+	if( (Address & (PAGE_SIZE - 1)) || (NumBytes & (PAGE_SIZE - 1)) || 
+		(Address < 0) || (NumBytes < 0) || ((Address + NumBytes) > VOLSIZE) )
+		return MEMFAIL;
+	
+	first = Address / PAGE_SIZE;
+	last = (Address + NumBytes) / PAGE_SIZE;
+	
+	for( chip=0 ; chip<NUM_CHIPS ; chip++ )
+	{
+		if( VolMode == VOL_STRIPED )
+		{
+			//	Chip c has logical pages c, c+N, ...  at physical page p/N
+			lo[chip] = ((first + NUM_CHIPS - 1 - chip) / NUM_CHIPS) * PAGE_SIZE;
+			hi[chip] = ((last + NUM_CHIPS - 1 - chip) / NUM_CHIPS) * PAGE_SIZE;
+		}
+		else
+		{
+			lo[chip] = first * PAGE_SIZE - (long)chip * (MEMSIZE + 1);
+			hi[chip] = last * PAGE_SIZE - (long)chip * (MEMSIZE + 1);
+			if( lo[chip] < 0 )
+				lo[chip] = 0;
+			if( hi[chip] > (MEMSIZE + 1) )
+				hi[chip] = MEMSIZE + 1;
+		}
+		
+		if( lo[chip] >= hi[chip] )
+			continue;
+		
+		if( ProtectLimit( chip, &limit ) )
+			return MEMFAIL;
+		if( hi[chip] > (limit + 1) )
+			hi[chip] = limit + 1;
+		
+		if( lo[chip] < hi[chip] )
+			mask |= 1 << chip;
+	}
+	
+	//	Asked to erase protected memory and nothing else
+	if( (NumBytes > 0) && !mask )
+		return MEMFAIL;
+	
+	polls = ((unsigned long)VOL_TIMEOUT * 1000) / WIP_POLL_US;
+	
+	while( mask )
+	{
+		started = MEMFALSE;
+		
+		for( chip=0 ; chip<NUM_CHIPS ; chip++ )
+		{
+			if( !(mask & (1 << chip)) )
+				continue;
+			
+			busy = IsBusy( chip );
+			if( busy == MEMFAIL )
+				return MEMFAIL;
+			if( busy == MEMTRUE )
+				continue;
+			
+			if( (lo[chip] == 0) && (hi[chip] == (MEMSIZE + 1)) )
+			{
+				if( StartErase( chip, MCE, 0 ) )
+					return MEMFAIL;
+				lo[chip] = hi[chip];
+			}
+			else if( !(lo[chip] & (SECTOR_SIZE - 1)) && ((lo[chip] + SECTOR_SIZE) <= hi[chip]) )
+			{
+				if( StartErase( chip, MSE, lo[chip] ) )
+					return MEMFAIL;
+				lo[chip] += SECTOR_SIZE;
+			}
+			else
+			{
+				if( StartErase( chip, MPE, lo[chip] ) )
+					return MEMFAIL;
+				lo[chip] += PAGE_SIZE;
+			}
+			
+			if( lo[chip] >= hi[chip] )
+				mask &= ~(1 << chip);
+			started = MEMTRUE;
+		}
+		
+		//	Nobody was free - wait a bit, but not forever
+		if( !started )
+		{
+			if( polls-- == 0 )
+				return MEMFAIL;
+			_delay_us( WIP_POLL_US );
+		}
+		else
+			polls = ((unsigned long)VOL_TIMEOUT * 1000) / WIP_POLL_US;
+	}
+	
+	return VolFlush();
+}
+
+/*************************************************************************
+Sequential writer with erase-ahead
+
+For logging:  data goes into the region [start, end) front to back, and 
+wraps around at the end.  Every page is erased before it is written, 
+and rather than stalling the writer for each erase, the writer keeps 
+the next `pages` pages erased ahead of itself.  An erase is only 
+started on a chip that is idle, so it never waits:
+	- with several chips (VOL_STRIPED) the upcoming pages are on other 
+		chips, and get erased while this one is burning its page
+	- on a single chip the erase goes out as soon as the last page 
+		program finishes - usually while the caller is off collecting
+		the next record
+In VOL_LINEAR mode a whole sector that falls inside the erase-ahead 
+window gets one sector erase instead of 128 page erases.
+
+Call VolSeqService() from an idle loop to keep the erasing going 
+between writes.
+*************************************************************************/
+
+//	Wraps an address back into the writer's region
+static long	VolSeqWrap( VolSeqWriter* w, long Address )
+{
+	if( Address >= w->end )
+		Address -= (w->end - w->start);
+	
+	return Address;
+}
+
+//	Bytes erased ahead of next
+static long	VolSeqLead( VolSeqWriter* w )
+{
+	long	lead;
+	
+	lead = w->erased - w->next;
+	if( lead < 0 )
+		lead += (w->end - w->start);
+	
+	return lead;
+}
+
+/*************************************************************************
+Sets up a writer
+
+Inputs:
+	long start, end	- the region, page aligned
+	long pos		- where to start writing (e.g. the end of an existing log)
+	short pages		- pages to keep erased ahead of the writer
+	
+Returns
+	MEMSUCC	- on success
+	MEMFAIL	- bad region
+*************************************************************************/
+short	VolSeqOpen( VolSeqWriter* w, long start, long end, long pos, short pages )
+{
+	if( (start < 0) || (end > VOLSIZE) || (start >= end) )
+		return MEMFAIL;
+	
+	if( (start & (PAGE_SIZE - 1)) || (end & (PAGE_SIZE - 1)) )
+		return MEMFAIL;
+	
+	if( (pos < start) || (pos >= end) )
+		return MEMFAIL;
+	
+	w->start = start;
+	w->end = end;
+	w->next = pos;
+	
+	//	The rest of a partly written page is assumed to still be erased
+	w->erased = VolSeqWrap( w, (pos + PAGE_SIZE - 1) & ~(long)(PAGE_SIZE - 1) );
+	
+	//	Never erase the page being written, or the one just behind it - 
+	//		the lead is measured from mid-page, so with a cap of one page
+	//		short of the region the erasing gets round to the page before
+	w->ahead = (long)pages * PAGE_SIZE;
+	if( w->ahead > (end - start - 2 * PAGE_SIZE) )
+		w->ahead = end - start - 2 * PAGE_SIZE;
+	if( w->ahead < 0 )
+		w->ahead = 0;
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Starts erases on idle chips until `ahead` bytes are erased ahead of 
+the writer (or the next chip in line is busy).  Never waits.
+*************************************************************************/
+short	VolSeqService( VolSeqWriter* w )
+{
+	short	chip;
+	long	PhysAddr;
+	short	busy;
+	
+	while( VolSeqLead( w ) < w->ahead )
+	{
+		if( VolMap( w->erased, &chip, &PhysAddr ) )
+			return MEMFAIL;
+		
+		busy = IsBusy( chip );
+		if( busy == MEMFAIL )
+			return MEMFAIL;
+		if( busy == MEMTRUE )
+			break;				//	Catch it next time
+		
+		if( (VolMode == VOL_LINEAR) && !(PhysAddr & (SECTOR_SIZE - 1)) && 
+			((w->erased + SECTOR_SIZE) <= w->end) && 
+			((VolSeqLead( w ) + SECTOR_SIZE) <= w->ahead) )
+		{
+			if( StartErase( chip, MSE, PhysAddr ) )
+				return MEMFAIL;
+			
+			w->erased = VolSeqWrap( w, w->erased + SECTOR_SIZE );
+		}
+		else
+		{
+			if( StartErase( chip, MPE, PhysAddr ) )
+				return MEMFAIL;
+			
+			w->erased = VolSeqWrap( w, w->erased + PAGE_SIZE );
+		}
+	}
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Appends data at the writer's position (wrapping at the end of the 
+region).  If the erase-ahead didn't get to the next page in time, it is 
+erased now - VolWrite() waits for that erase before programming.
+
+NOTE:  Like VolWrite(), returns with write cycles still running
+*************************************************************************/
+short	VolSeqWrite( VolSeqWriter* w, long NumBytes, const uint8_t* data )
+{
+	short	chip;
+	long	PhysAddr;
+	long	chunk;
+	
+	while( NumBytes > 0 )
+	{
+		//	Starting a page that isn't erased yet?
+		if( !(w->next & (PAGE_SIZE - 1)) && (VolSeqLead( w ) == 0) )
+		{
+			if( VolMap( w->next, &chip, &PhysAddr ) )
+				return MEMFAIL;
+			
+			if( WaitWriteComplete( chip, VOL_TIMEOUT ) || StartErase( chip, MPE, PhysAddr ) )
+				return MEMFAIL;
+			
+			w->erased = VolSeqWrap( w, w->next + PAGE_SIZE );
+		}
+		
+		chunk = PageRemain( w->next );
+		if( chunk > NumBytes )
+			chunk = NumBytes;
+		
+		if( VolWrite( w->next, chunk, data ) )
+			return MEMFAIL;
+		
+		w->next = VolSeqWrap( w, w->next + chunk );
+		data += chunk;
+		NumBytes -= chunk;
+		
+		if( VolSeqService( w ) )
+			return MEMFAIL;
+	}
+	
+	return MEMSUCC;
+}
@@ -0,0 +1,64 @@
+/*
+ * _25AA1024Vol.h
+ *
+ * Logical volume:  up to NUM_CHIPS 25AA1024s as one address space
+ */ 
+
+/*************************************************************************
+Description:
+Presents all NUM_CHIPS memories as one big device of VolSize() bytes.
+Two layouts:
+
+VOL_LINEAR	- chip 0 holds the first 128K, chip 1 the next, etc.
+
+VOL_STRIPED	- pages are interleaved round-robin:  logical page n lives 
+	on chip (n % NUM_CHIPS).  A sequential write then lands on a 
+	different chip for each page, so while one chip is burning a page 
+	the next page goes out to the next chip.  With 4 chips the 6ms 
+	write cycle is almost completely hidden.
+
+NOTE:  VolWrite() does NOT wait for the last write cycle(s) to finish.
+	Every Vol function waits for a chip to be idle before talking to it, 
+	so this is invisible to Vol callers - but call VolFlush() before
+	powering down, or before going around the Vol layer.
+	
+NOTE:  The layout is not stored anywhere.  Use the same mode every time.
+*************************************************************************/
+#include "25AA1024.h"
+
+
+#ifndef _25AA1024VOL_H_
+#define _25AA1024VOL_H_
+
+#define VOL_LINEAR		0
+#define VOL_STRIPED		1
+
+#define VOLSIZE		((long)NUM_CHIPS * (MEMSIZE + 1))	//	Size of the volume (in bytes)
+#define VOL_TIMEOUT	MTCE		//	Longest a chip can be busy with anything (ms)
+
+
+//	Sequential (log style) writer with erase-ahead - see VolSeqWrite()
+typedef struct
+{
+	long	start;			//	Region [start, end) of the volume, page aligned
+	long	end;
+	long	next;			//	Next address to be written
+	long	erased;			//	Next page to be erased;  [next, erased) is erased (or being erased)
+	long	ahead;			//	How far ahead of next to keep erased (bytes)
+} VolSeqWriter;
+
+
+//	Functions
+short	VolInit( short mode );
+void	VolClose( void );
+long	VolSize( void );
+short	VolMap( long Address, short* chip, long* PhysAddr );
+short	VolRead( long Address, long NumBytes, uint8_t* data );
+short	VolWrite( long Address, long NumBytes, const uint8_t* data );
+short	VolFlush( void );
+short	VolErase( long Address, long NumBytes );
+short	VolSeqOpen( VolSeqWriter* w, long start, long end, long pos, short pages );
+short	VolSeqWrite( VolSeqWriter* w, long NumBytes, const uint8_t* data );
+short	VolSeqService( VolSeqWriter* w );
+
+#endif /* _25AA1024VOL_H_ */
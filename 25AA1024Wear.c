@@ -0,0 +1,299 @@
+/*
+ * _25AA1024Wear.c
+ *
+ * Per-page program/erase cycle tracking
+ */ 
+
+#include "25AA1024Wear.h"
+#include <util/crc16.h>
+#include <string.h>
+
+#if WEAR_USED
+
+#if (WEAR_SHIFT < 1) || (WEAR_SHIFT > 2)
+#error "WEAR_SHIFT must be 1 or 2"
+#endif
+
+#ifndef WEAR_PAGE
+#error "WEAR_USED needs WEAR_PAGE (see 25AA1024Wear.h)"
+#endif
+#if WEAR_PAGE & (PAGE_SIZE - 1)
+#error "WEAR_PAGE must be page aligned"
+#endif
+
+#define WEAR_BYTES		(WEAR_GROUPS / 2)
+
+//	magic, format, counters, CRC - all in one page write
+#if (2 + WEAR_BYTES + 2) > PAGE_SIZE
+#error "The wear counters don't fit in a page - raise WEAR_GROUP_SHIFT"
+#endif
+#define WEAR_FORMAT		((WEAR_GROUP_SHIFT << 4) | WEAR_SHIFT)	//	Saved counters only make sense with the same settings
+
+static uint8_t		WearCount[NUM_CHIPS][WEAR_BYTES];	//	Two counters per byte, low nibble first
+static uint8_t		WearDirty[NUM_CHIPS];				//	Steps since the last save
+static uint32_t		WearRandom = 0x2545F491;			//	xorshift state
+
+
+static inline uint8_t	WearGet( short chip, short group )
+{
+	uint8_t	b = WearCount[chip][group >> 1];
+	
+	return (group & 1) ? (b >> 4) : (b & 0x0F);
+}
+
+static inline void	WearPut( short chip, short group, uint8_t c )
+{
+	uint8_t*	b = &WearCount[chip][group >> 1];
+	
+	if( group & 1 )
+		*b = (*b & 0x0F) | (c << 4);
+	else
+		*b = (*b & 0xF0) | c;
+}
+
+//	Estimated cycles for a counter value
+static uint32_t	WearEstimate( uint8_t c )
+{
+	return ((1UL << (WEAR_SHIFT * c)) - 1) / ((1UL << WEAR_SHIFT) - 1);
+}
+
+/*************************************************************************
+One cycle on a group:  step its counter with probability 1/2^(SHIFT*c)
+*************************************************************************/
+static void	WearBump( short chip, short group )
+{
+	uint8_t		c = WearGet( chip, group );
+	uint32_t	r;
+	
+	if( c >= 15 )
+		return;							//	Saturated
+	
+	r = WearRandom;
+	r ^= r << 13;
+	r ^= r >> 17;
+	r ^= r << 5;
+	WearRandom = r;
+	
+	if( r & ((1UL << (WEAR_SHIFT * c)) - 1) )
+		return;
+	
+	WearPut( chip, group, c + 1 );
+	
+	if( WearDirty[chip] < 0xFF )
+		WearDirty[chip]++;
+}
+
+/*************************************************************************
+Driver hooks
+*************************************************************************/
+void	WearProgrammed( short chip, long Address )
+{
+	if( (chip < 0) || (chip >= NUM_CHIPS) )
+		return;
+	
+	WearBump( chip, (short)((Address >> 8) & (NUM_PAGES - 1)) >> WEAR_GROUP_SHIFT );
+}
+
+void	WearErased( short chip, uint8_t Command, long Address )
+{
+	short	first;
+	short	count;
+	
+	if( (chip < 0) || (chip >= NUM_CHIPS) )
+		return;
+	
+	if( Command == MCE )
+	{
+		first = 0;
+		count = WEAR_GROUPS;
+	}
+	else if( Command == MSE )
+	{
+		first = (short)((Address & MEMSIZE & ~(SECTOR_SIZE - 1)) >> 8) >> WEAR_GROUP_SHIFT;
+		count = (SECTOR_SIZE / PAGE_SIZE) >> WEAR_GROUP_SHIFT;
+	}
+	else
+	{
+		first = (short)((Address >> 8) & (NUM_PAGES - 1)) >> WEAR_GROUP_SHIFT;
+		count = 1;
+	}
+	
+	while( count-- )
+		WearBump( chip, first++ );
+}
+
+/*************************************************************************
+Save / restore.  The page holds:  magic, format, the counters, CRC.
+WearLoad() starts from zero if there's nothing valid saved;  it only 
+fails if the chip can't be read.
+*************************************************************************/
+short	WearLoad( short chip )
+{
+	uint8_t		hdr[2];
+	uint16_t	crc = MEMCRC_INIT;
+	uint16_t	saved;
+	short		i;
+	
+	if( (chip < 0) || (chip >= NUM_CHIPS) )
+		return MEMFAIL;
+	
+	if( ReadBytes( chip, WEAR_PAGE, 2, hdr ) ||
+		ReadBytes( chip, WEAR_PAGE + 2, WEAR_BYTES, WearCount[chip] ) ||
+		ReadBytes( chip, WEAR_PAGE + 2 + WEAR_BYTES, 2, (uint8_t*)&saved ) )
+	{
+		WearClear( chip );
+		return MEMFAIL;
+	}
+	
+	for( i=0 ; i<2 ; i++ )
+		crc = _crc_ccitt_update( crc, hdr[i] );
+	for( i=0 ; i<WEAR_BYTES ; i++ )
+		crc = _crc_ccitt_update( crc, WearCount[chip][i] );
+	
+	WearDirty[chip] = 0;
+	
+	//	Never saved (or saved with other settings):  start from zero
+	if( (hdr[0] != WEAR_MAGIC) || (hdr[1] != WEAR_FORMAT) || (crc != saved) )
+		WearClear( chip );
+	
+	return MEMSUCC;
+}
+
+short	WearSave( short chip )
+{
+	uint8_t		buf[2 + WEAR_BYTES + 2];
+	uint16_t	crc = MEMCRC_INIT;
+	short		i;
+	
+	if( (chip < 0) || (chip >= NUM_CHIPS) )
+		return MEMFAIL;
+	
+	buf[0] = WEAR_MAGIC;
+	buf[1] = WEAR_FORMAT;
+	memcpy( &buf[2], WearCount[chip], WEAR_BYTES );
+	
+	for( i=0 ; i<2 + WEAR_BYTES ; i++ )
+		crc = _crc_ccitt_update( crc, buf[i] );
+	memcpy( &buf[2 + WEAR_BYTES], &crc, 2 );
+	
+	//	The EEPROM rewrites in place - no erase needed
+	if( WaitWriteComplete( chip, MTCE ) ||
+		WritePage( chip, WEAR_PAGE, sizeof(buf), buf ) ||
+		WaitWriteComplete( chip, MTWC ) )
+		return MEMFAIL;
+	
+	WearDirty[chip] = 0;
+	
+	return MEMSUCC;
+}
+
+/*************************************************************************
+Saves any chip that has moved WEAR_SAVE_EVERY counter steps.  Call from 
+an idle loop.
+*************************************************************************/
+short	WearService( void )
+{
+	short	chip;
+	
+	for( chip=0 ; chip<NUM_CHIPS ; chip++ )
+		if( WearDirty[chip] >= WEAR_SAVE_EVERY )
+			if( WearSave( chip ) )
+				return MEMFAIL;
+	
+	return MEMSUCC;
+}
+
+void	WearClear( short chip )
+{
+	if( (chip < 0) || (chip >= NUM_CHIPS) )
+		return;
+	
+	memset( WearCount[chip], 0, WEAR_BYTES );
+	WearDirty[chip] = 0;
+}
+
+/*************************************************************************
+Estimated cycles of the group that page is in
+*************************************************************************/
+uint32_t	WearCycles( short chip, short page )
+{
+	if( (chip < 0) || (chip >= NUM_CHIPS) )
+		return 0;
+	
+	return WearEstimate( WearGet( chip, (page & (NUM_PAGES - 1)) >> WEAR_GROUP_SHIFT ) );
+}
+
+/*************************************************************************
+Least worn page of [first, first+count) - the first one of the coolest 
+group in there.  For placement decisions.
+*************************************************************************/
+short	WearCoolest( short chip, short first, short count )
+{
+	short	best = first;
+	uint8_t	bestc = 0xFF;
+	uint8_t	c;
+	short	page;
+	
+	if( (chip < 0) || (chip >= NUM_CHIPS) )
+		return first;
+	
+	for( page=first ; page<first + count ; page++ )
+	{
+		c = WearGet( chip, page >> WEAR_GROUP_SHIFT );
+		if( c < bestc )
+		{
+			best = page;
+			bestc = c;
+			
+			if( c == 0 )
+				break;
+		}
+		
+		//	Skip to the next group
+		page |= (1 << WEAR_GROUP_SHIFT) - 1;
+	}
+	
+	return best;
+}
+
+/*************************************************************************
+Hot page report:  fills hot[] with up to max of the most worn groups,
+hottest first.  Groups that have never been counted are left out.
+
+Returns
+	how many entries were filled in
+*************************************************************************/
+short	WearReport( short chip, WearHot* hot, short max )
+{
+	short	used = 0;
+	short	g;
+	short	i;
+	uint8_t	c;
+	
+	if( (chip < 0) || (chip >= NUM_CHIPS) )
+		return 0;
+	
+	for( g=0 ; g<WEAR_GROUPS ; g++ )
+	{
+		c = WearGet( chip, g );
+		if( c == 0 )
+			continue;
+		
+		//	Insertion into the (short) sorted list
+		for( i=used ; (i > 0) && (hot[i - 1].cycles < WearEstimate( c )) ; i-- )
+			if( i < max )
+				hot[i] = hot[i - 1];
+		
+		if( i < max )
+		{
+			hot[i].page = g << WEAR_GROUP_SHIFT;
+			hot[i].cycles = WearEstimate( c );
+			if( used < max )
+				used++;
+		}
+	}
+	
+	return used;
+}
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ * _25AA1024Wear.h
+ *
+ * Per-page program/erase cycle tracking
+ */ 
+
+/*************************************************************************
+Description:
+Counts write and erase cycles per group of pages, so the layers above 
+can steer writes away from worn pages and a report can show where the 
+wear is going.
+
+Counters are 4 bit approximate (Morris) counters, two to a byte:  a 
+counter at c moves to c+1 with probability 1/2^(WEAR_SHIFT * c), so it
+stands for about (2^(WEAR_SHIFT * c) - 1) / (2^WEAR_SHIFT - 1) cycles.
+With the default WEAR_SHIFT of 2, 15 covers ~358M cycles - well past 
+the 1M endurance - in steps of 4x.  WEAR_SHIFT 1 gives 2x steps but 
+tops out at 32767.
+
+One counter covers 2^WEAR_GROUP_SHIFT pages (4 by default - 64 bytes 
+of RAM per chip) and counts cycles that hit the group:  a page write 
+or page erase in it, or a sector/chip erase over it.  So it's an upper
+bound on the cycles of any one page in the group.
+
+The driver feeds it (WEAR_USED in 25AA1024.h) from BeginPageWrite(), 
+MemSubmit() and StartErase().  WearLoad() restores the counters from 
+WEAR_PAGE on the chip;  WearService() writes them back there every 
+WEAR_SAVE_EVERY counter steps, so at most a few steps are lost at 
+power-off.
+
+NOTE:  WEAR_PAGE has no default:  define it as a page kept for this 
+	alone - out of whatever the volume/log/KV layers use, and out of 
+	any block protected part, or the saves fail.
+NOTE:  The saved record (4 bytes + WEAR_GROUPS / 2) has to fit in a 
+	page, so WEAR_GROUP_SHIFT 0 (one counter per page) won't build.
+NOTE:  Protected erases (which the chip ignores) are still counted.
+*************************************************************************/
+#include "25AA1024.h"
+
+
+#ifndef _25AA1024WEAR_H_
+#define _25AA1024WEAR_H_
+
+#ifndef WEAR_SHIFT
+#define WEAR_SHIFT			2			//	log2 of the counter base (1 or 2)
+#endif
+#ifndef WEAR_GROUP_SHIFT
+#define WEAR_GROUP_SHIFT	2			//	log2 of pages per counter
+#endif
+//	WEAR_PAGE - where each chip's counters are saved (page aligned, see above)
+#define WEAR_SAVE_EVERY		4			//	Counter steps between saves
+#define WEAR_GROUPS			(NUM_PAGES >> WEAR_GROUP_SHIFT)
+#define WEAR_MAGIC			0x57		//	'W'
+
+typedef struct
+{
+	short		page;					//	First page of the group
+	uint32_t	cycles;					//	Estimated cycles
+} WearHot;
+
+//	Functions
+short		WearLoad( short chip );
+short		WearSave( short chip );
+short		WearService( void );
+void		WearClear( short chip );
+uint32_t	WearCycles( short chip, short page );
+short		WearCoolest( short chip, short first, short count );
+short		WearReport( short chip, WearHot* hot, short max );
+
+//	Driver hooks
+void		WearProgrammed( short chip, long Address );
+void		WearErased( short chip, uint8_t Command, long Address );
+
+#endif /* _25AA1024WEAR_H_ */
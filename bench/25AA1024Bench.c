@@ -0,0 +1,381 @@
+/*
+ * _25AA1024Bench.c
+ *
+ * Benchmark firmware for the 25AA1024 driver
+ */ 
+
+/*************************************************************************
+Description:
+Stand-alone firmware that times the driver on the target and prints the
+results over a serial line, so SCK/transport settings can be picked 
+and regressions caught when the driver changes.
+
+For each chip (0..NUM_CHIPS-1) it measures:
+	- !CS low/high pair (ClearCS + SetCS)
+	- READ command + address (no data)
+	- ReadBytes() of 1, 16, 64, 256 and 4096 bytes
+	- the same lengths through a MemReader (sequential, no re-addressing)
+	- a full page write (WritePage + wait) and a 16 byte partial page write
+	- page and sector erase (+ wait), and chip erase if BENCH_CHIPERASE
+	- SleepMem(), WakeMem() and WakeMemFast()
+
+Each line is "chip test bytes ticks us bytes/s" - ticks are Timer1 counts
+at F_CPU/8.
+
+Timing is Timer1 (16 bit) with an overflow interrupt extending it to 32
+bits, so it works on the ATtiny as well as the ATmega.  Output goes to
+USART0 if the part has one, otherwise a bit-banged TX pin.
+
+NOTE:  DESTRUCTIVE.  Writes and erases BENCH_PAGE and the sector it's in
+	on every chip (and the whole chip with BENCH_CHIPERASE).  Clear the 
+	block protect bits first, or the write/erase numbers are meaningless.
+NOTE:  BENCH_PAGE defaults to page 0.  Sharing a sector with WEAR_PAGE
+	or SCKCAL_ADDR (when used) is an #error, since the sector erase 
+	would wipe the saved wear counters / SCK pattern.  BENCH_CHIPERASE wipes them regardless.
+
+Build (ATtiny84, USI transport, from the repo root):
+	avr-gcc -mmcu=attiny84 -Os -DF_CPU=8000000UL -DFASTSPI_USED=1 -I. \
+		-o bench.elf bench/25AA1024Bench.c 25AA1024.c
+	(leave FASTSPI_USED out and add TinySPI.c for the TinySPI transport)
+Build (ATmega328P, hardware SPI - set the port/pin block in 25AA1024.h 
+for the board first):
+	avr-gcc -mmcu=atmega328p -Os -DF_CPU=16000000UL -DMEMXPORT=2 -I. \
+		-o bench.elf bench/25AA1024Bench.c 25AA1024.c
+*************************************************************************/
+#include "25AA1024.h"
+#include "25AA1024Wear.h"
+#include <avr/interrupt.h>
+#include <util/delay.h>
+
+
+#ifndef BENCH_PAGE
+#define BENCH_PAGE		0x000000	//	Scratch page (its sector gets erased too)
+#endif
+
+#if WEAR_USED && defined(WEAR_PAGE) && ((BENCH_PAGE / SECTOR_SIZE) == (WEAR_PAGE / SECTOR_SIZE))
+#error "BENCH_PAGE shares a sector with WEAR_PAGE - the bench would wipe the wear counters"
+#endif
+#if SCKCAL_USED && ((BENCH_PAGE / SECTOR_SIZE) == (SCKCAL_ADDR / SECTOR_SIZE))
+#error "BENCH_PAGE shares a sector with SCKCAL_ADDR - the bench would wipe the SCK test pattern"
+#endif
+#ifndef BENCH_CHIPERASE
+#define BENCH_CHIPERASE	MEMFALSE	//	Also time a full chip erase
+#endif
+#ifndef BENCH_BAUD
+#define BENCH_BAUD		9600
+#endif
+
+//	Bit-banged TX pin, for parts without a USART
+#ifndef BENCH_TX_PORT
+#define BENCH_TX_PORT	PORTB
+#define BENCH_TX_DDR	DDRB
+#define BENCH_TX_BIT	0
+#endif
+
+#define BENCH_PRESCALE	8			//	Timer1 prescale (CS11)
+#define BENCH_READS		5			//	Entries in ReadSizes
+#define BENCH_REPEAT	100			//	Loops for the sub-byte sized tests
+
+static const uint16_t	ReadSizes[BENCH_READS] = { 1, 16, 64, 256, 4096 };
+
+static volatile uint16_t	TimerHigh;		//	Timer1 overflows
+static uint8_t				Buf[PAGE_SIZE];
+
+
+/*************************************************************************
+Timer
+*************************************************************************/
+#ifdef TIM1_OVF_vect
+ISR( TIM1_OVF_vect )
+#else
+ISR( TIMER1_OVF_vect )
+#endif
+{
+	TimerHigh++;
+}
+
+static void	TimerInit( void )
+{
+	TCCR1A = 0;
+	TCCR1B = (1<<CS11);				//	F_CPU / 8
+	TIMSK1 = (1<<TOIE1);
+	sei();
+}
+
+//	32 bit tick count.  Reads TCNT1 and the overflow count consistently.
+static uint32_t	TimerNow( void )
+{
+	uint16_t	hi;
+	uint16_t	lo;
+	uint8_t		sreg = SREG;
+	
+	cli();
+	hi = TimerHigh;
+	lo = TCNT1;
+	
+	//	Overflowed but not serviced yet
+	if( (TIFR1 & (1<<TOV1)) && (lo < 0x8000) )
+		hi++;
+	
+	SREG = sreg;
+	
+	return ((uint32_t)hi << 16) | lo;
+}
+
+
+/*************************************************************************
+Serial output
+*************************************************************************/
+#ifdef UDR0
+
+static void	SerialInit( void )
+{
+	UBRR0 = (F_CPU / (16UL * BENCH_BAUD)) - 1;
+	UCSR0B = (1<<TXEN0);
+	UCSR0C = (1<<UCSZ01)|(1<<UCSZ00);		//	8N1
+}
+
+static void	SerialPut( char c )
+{
+	while( !(UCSR0A & (1<<UDRE0)) )
+		;
+	UDR0 = c;
+}
+
+#else
+
+static void	SerialInit( void )
+{
+	BENCH_TX_PORT |= (1<<BENCH_TX_BIT);		//	Idle high
+	BENCH_TX_DDR |= (1<<BENCH_TX_BIT);
+}
+
+//	8N1, interrupts off so the timer doesn't stretch the bits
+static void	SerialPut( char c )
+{
+	uint8_t	sreg = SREG;
+	uint8_t	i;
+	
+	cli();
+	
+	BENCH_TX_PORT &= ~(1<<BENCH_TX_BIT);	//	Start bit
+	_delay_us( 1000000.0 / BENCH_BAUD );
+	
+	for( i=0 ; i<8 ; i++ )
+	{
+		if( c & 1 )
+			BENCH_TX_PORT |= (1<<BENCH_TX_BIT);
+		else
+			BENCH_TX_PORT &= ~(1<<BENCH_TX_BIT);
+		c >>= 1;
+		_delay_us( 1000000.0 / BENCH_BAUD );
+	}
+	
+	BENCH_TX_PORT |= (1<<BENCH_TX_BIT);		//	Stop bit
+	_delay_us( 1000000.0 / BENCH_BAUD );
+	
+	SREG = sreg;
+}
+
+#endif
+
+static void	SerialStr( const char* s )
+{
+	while( *s )
+		SerialPut( *s++ );
+}
+
+static void	SerialNum( uint32_t n )
+{
+	char	digits[10];
+	short	i = 0;
+	
+	do
+	{
+		digits[i++] = '0' + (n % 10);
+		n /= 10;
+	} while( n );
+	
+	while( i )
+		SerialPut( digits[--i] );
+}
+
+
+/*************************************************************************
+One result line:  chip test bytes ticks us bytes/s  (or FAIL)
+*************************************************************************/
+static void	Report( short chip, const char* test, uint32_t bytes, uint32_t ticks, short err )
+{
+	uint32_t	us;
+	
+	SerialNum( chip );
+	SerialPut( ' ' );
+	SerialStr( test );
+	SerialPut( ' ' );
+	SerialNum( bytes );
+	SerialPut( ' ' );
+	
+	if( err )
+	{
+		SerialStr( "FAIL\r\n" );
+		return;
+	}
+	
+	us = (ticks * BENCH_PRESCALE) / (F_CPU / 1000000UL);
+	
+	SerialNum( ticks );
+	SerialPut( ' ' );
+	SerialNum( us );
+	SerialPut( ' ' );
+	SerialNum( ticks ? (uint32_t)(((uint64_t)bytes * (F_CPU / BENCH_PRESCALE)) / ticks) : 0 );
+	SerialStr( "\r\n" );
+}
+
+
+/*************************************************************************
+The tests
+*************************************************************************/
+static void	BenchBus( short chip )
+{
+	uint32_t	t;
+	short		err = MEMSUCC;
+	short		i;
+	
+	t = TimerNow();
+	for( i=0 ; i<BENCH_REPEAT ; i++ )
+	{
+		err |= ClearCS( chip );
+		err |= SetCS( chip );
+	}
+	Report( chip, "cs_x100", 0, TimerNow() - t, err );
+	
+	t = TimerNow();
+	for( i=0 ; i<BENCH_REPEAT ; i++ )
+	{
+		err |= SendCommandAndAddress( chip, MREAD, 0 );
+		err |= SetCS( chip );
+	}
+	Report( chip, "cmdaddr_x100", 0, TimerNow() - t, err );
+}
+
+static void	BenchRead( short chip )
+{
+	MemReader	rd;
+	uint32_t	t;
+	long		done;
+	short		err;
+	short		i;
+	uint16_t	n;
+	
+	for( i=0 ; i<BENCH_READS ; i++ )
+	{
+		n = ReadSizes[i];
+		err = MEMSUCC;
+		
+		//	Big reads go through the page buffer a page at a time
+		t = TimerNow();
+		for( done=0 ; done<n ; done+=PAGE_SIZE )
+			err |= ReadBytes( chip, done, (n - done < PAGE_SIZE) ? n - done : PAGE_SIZE, Buf );
+		Report( chip, "read", n, TimerNow() - t, err );
+		
+		err = MEMSUCC;
+		ReaderOpen( &rd, chip );
+		t = TimerNow();
+		for( done=0 ; done<n ; done+=PAGE_SIZE )
+			err |= ReaderRead( &rd, done, (n - done < PAGE_SIZE) ? n - done : PAGE_SIZE, Buf );
+		err |= ReaderClose( &rd );
+		Report( chip, "seqread", n, TimerNow() - t, err );
+	}
+}
+
+static void	BenchWrite( short chip )
+{
+	uint32_t	t;
+	short		err;
+	short		i;
+	
+	for( i=0 ; i<PAGE_SIZE ; i++ )
+		Buf[i] = (uint8_t)i;
+	
+	//	Write onto an erased page, so it's the same every time
+	err = ErasePage( chip, BENCH_PAGE );
+	t = TimerNow();
+	if( !err )
+		err = WritePage( chip, BENCH_PAGE, PAGE_SIZE, Buf ) || WaitWriteComplete( chip, MTWC );
+	Report( chip, "writepage", PAGE_SIZE, TimerNow() - t, err );
+	
+	t = TimerNow();
+	err = WritePage( chip, BENCH_PAGE + 64, 16, Buf ) || WaitWriteComplete( chip, MTWC );
+	Report( chip, "writepart", 16, TimerNow() - t, err );
+}
+
+static void	BenchErase( short chip )
+{
+	uint32_t	t;
+	short		err;
+	
+	t = TimerNow();
+	err = ErasePage( chip, BENCH_PAGE );
+	Report( chip, "erasepage", PAGE_SIZE, TimerNow() - t, err );
+	
+	t = TimerNow();
+	err = EraseSector( chip, BENCH_PAGE );
+	Report( chip, "erasesector", SECTOR_SIZE, TimerNow() - t, err );
+	
+#if BENCH_CHIPERASE
+	t = TimerNow();
+	err = EraseChip( chip );
+	Report( chip, "erasechip", MEMSIZE + 1, TimerNow() - t, err );
+#endif
+}
+
+static void	BenchPower( short chip )
+{
+	uint32_t	t;
+	short		err;
+	
+	t = TimerNow();
+	err = SleepMem( chip );
+	Report( chip, "sleep", 0, TimerNow() - t, err );
+	
+	t = TimerNow();
+	err = WakeMem( chip );
+	Report( chip, "wake", 0, TimerNow() - t, err );
+	
+	SleepMem( chip );
+	t = TimerNow();
+	err = WakeMemFast( chip );
+	Report( chip, "wakefast", 0, TimerNow() - t, err );
+}
+
+int	main( void )
+{
+	short	chip;
+	
+	TimerInit();
+	SerialInit();
+	
+	SerialStr( "25AA1024 bench, F_CPU " );
+	SerialNum( F_CPU );
+	SerialStr( "\r\nchip test bytes ticks us bytes/s\r\n" );
+	
+	for( chip=0 ; chip<NUM_CHIPS ; chip++ )
+	{
+		if( InitMem( chip ) || WakeMem( chip ) )
+		{
+			Report( chip, "init", 0, 0, MEMFAIL );
+			continue;
+		}
+		
+		BenchBus( chip );
+		BenchRead( chip );
+		BenchWrite( chip );
+		BenchErase( chip );
+		BenchPower( chip );
+	}
+	
+	SerialStr( "done\r\n" );
+	
+	for( ;; )
+		;
+}
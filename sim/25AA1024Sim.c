@@ -0,0 +1,352 @@
+/*
+ * _25AA1024Sim.c
+ *
+ * Host-side model of the 25AA1024
+ */ 
+
+#include "25AA1024Sim.h"
+#include "TinySPI.h"
+#include <util/delay.h>
+#include <string.h>
+
+
+volatile uint8_t	PORTA = 0xFF, DDRA;		//	Pulled up:  every !CS starts high
+volatile uint8_t	PORTB = 0xFF, DDRB;
+
+typedef struct
+{
+	uint8_t		mem[MEMSIZE + 1];
+	uint8_t		page[PAGE_SIZE];	//	Page being written
+	uint8_t		status;				//	WEL, BP0, BP1 (WIP comes from busyUntil)
+	uint8_t		newStatus;			//	WRSR data
+	uint8_t		asleep;
+	uint8_t		selected;
+	uint8_t		cmd;
+	uint8_t		ignore;				//	Rest of this transaction is ignored
+	long		pos;				//	Bytes received since !CS went low
+	long		addr;
+	uint64_t	busyUntil;			//	ns
+	SimStats	stats;
+} SimChip;
+
+static SimChip		Chips[NUM_CHIPS];
+static uint64_t		Now;						//	ns
+static uint64_t		ByteNs = 8000000000ULL / SIM_SCK_HZ;
+static unsigned long	Contention;					//	Bytes clocked with more than one chip selected
+
+
+/*************************************************************************
+Clock
+*************************************************************************/
+static void	SimAdvance( uint64_t ns )
+{
+	Now += ns;
+}
+
+void	_delay_us( double us )
+{
+	SimAdvance( (uint64_t)(us * 1000.0) );
+}
+
+void	_delay_ms( double ms )
+{
+	SimAdvance( (uint64_t)(ms * 1000000.0) );
+}
+
+unsigned long	SimTimeUs( void )
+{
+	return (unsigned long)(Now / 1000);
+}
+
+void	SimSetSck( unsigned long hz )
+{
+	ByteNs = 8000000000ULL / hz;
+}
+
+
+/*************************************************************************
+Chip state
+*************************************************************************/
+static short	SimBusy( SimChip* c )
+{
+	return Now < c->busyUntil;
+}
+
+static void	SimStartCycle( SimChip* c, unsigned long us )
+{
+	c->busyUntil = Now + (uint64_t)us * 1000;
+	c->stats.busyUs += us;
+	c->status &= ~(1<<MWEL);		//	Every write/erase resets the latch
+}
+
+//	Highest writable address for the current BP bits (-1 = none)
+static long	SimLimit( SimChip* c )
+{
+	switch( (c->status >> MBP0) & 0x03 )
+	{
+		case 0:	return BP00;
+		case 1:	return BP01;
+		case 2:	return BP10;
+	}
+	return -1;
+}
+
+//	!CS just went low
+static void	SimSelect( SimChip* c )
+{
+	c->selected = MEMTRUE;
+	c->pos = 0;
+	c->addr = 0;
+	c->ignore = MEMFALSE;
+	c->stats.selects++;
+}
+
+//	!CS just went high - this is where writes/erases actually start
+static void	SimDeselect( SimChip* c )
+{
+	long	limit = SimLimit( c );
+	long	base;
+	short	ok = !c->ignore && (c->pos > 0);
+	
+	c->selected = MEMFALSE;
+	if( !ok )
+		return;
+	
+	if( c->cmd == MRDID )
+	{
+		c->asleep = MEMFALSE;
+		return;
+	}
+	
+	switch( c->cmd )
+	{
+		case MWREN:	c->status |= (1<<MWEL);		return;
+		case MWRDI:	c->status &= ~(1<<MWEL);	return;
+		case MDPD:	c->asleep = MEMTRUE;		return;
+		case MREAD:
+		case MRDSR:	return;
+	}
+	
+	//	Everything left needs the write enable latch
+	if( !(c->status & (1<<MWEL)) )
+	{
+		c->stats.ignored++;
+		return;
+	}
+	
+	switch( c->cmd )
+	{
+		case MWRSR:
+			if( c->pos < 2 )
+				break;
+			c->status = (c->status & ~((1<<MBP0)|(1<<MBP1))) | (c->newStatus & ((1<<MBP0)|(1<<MBP1)));
+			SimStartCycle( c, SIM_TWC_US );
+			return;
+		
+		case MWRITE:
+			if( c->pos < 5 )
+				break;
+			base = c->addr & ~(long)(PAGE_SIZE - 1);
+			if( base > limit )
+				break;
+			memcpy( &c->mem[base], c->page, PAGE_SIZE );
+			c->stats.programs++;
+			SimStartCycle( c, SIM_TWC_US );
+			return;
+		
+		case MPE:
+			if( (c->pos != 4) || ((c->addr | (PAGE_SIZE - 1)) > limit) )
+				break;
+			memset( &c->mem[c->addr & ~(long)(PAGE_SIZE - 1)], 0xFF, PAGE_SIZE );
+			c->stats.erases++;
+			SimStartCycle( c, SIM_TPE_US );
+			return;
+		
+		case MSE:
+			if( (c->pos != 4) || ((c->addr | (SECTOR_SIZE - 1)) > limit) )
+				break;
+			memset( &c->mem[c->addr & ~(long)(SECTOR_SIZE - 1)], 0xFF, SECTOR_SIZE );
+			c->stats.erases++;
+			SimStartCycle( c, SIM_TSE_US );
+			return;
+		
+		case MCE:
+			if( (c->pos != 1) || (limit != BP00) )
+				break;
+			memset( c->mem, 0xFF, sizeof(c->mem) );
+			c->stats.erases++;
+			SimStartCycle( c, SIM_TCE_US );
+			return;
+	}
+	
+	//	Protected, incomplete, or not a command
+	c->status &= ~(1<<MWEL);
+	c->stats.ignored++;
+}
+
+//	One byte in (from the master), one byte out
+static uint8_t	SimByte( SimChip* c, uint8_t in )
+{
+	uint8_t	out = 0xFF;
+	long	p = c->pos++;
+	
+	c->stats.bytes++;
+	
+	if( p == 0 )
+	{
+		c->cmd = in;
+		c->stats.commands[in]++;
+		
+		//	While busy only RDSR gets through;  asleep, only RDID
+		if( (SimBusy( c ) && (in != MRDSR)) || (c->asleep && (in != MRDID)) )
+		{
+			c->ignore = MEMTRUE;
+			c->stats.ignored++;
+		}
+		return out;
+	}
+	
+	if( c->ignore )
+		return out;
+	
+	switch( c->cmd )
+	{
+		case MRDSR:
+			out = c->status | (SimBusy( c ) ? (1<<MWIP) : 0);
+			return out;
+		
+		case MWRSR:
+			if( p == 1 )
+				c->newStatus = in;
+			return out;
+	}
+	
+	//	Everything else has three address bytes
+	if( p <= 3 )
+	{
+		c->addr = ((c->addr << 8) | in) & MEMSIZE;
+		
+		if( (p == 3) && (c->cmd == MWRITE) )
+			memcpy( c->page, &c->mem[c->addr & ~(long)(PAGE_SIZE - 1)], PAGE_SIZE );
+		return out;
+	}
+	
+	switch( c->cmd )
+	{
+		case MREAD:
+			//	Reads run on across pages, and wrap at the top of the array
+			out = c->mem[c->addr];
+			c->addr = (c->addr + 1) & MEMSIZE;
+			break;
+		
+		case MWRITE:
+			//	Writes wrap around inside the page
+			c->page[(c->addr + (p - 4)) & (PAGE_SIZE - 1)] = in;
+			break;
+		
+		case MRDID:
+			out = MDEVICE;
+			break;
+	}
+	
+	return out;
+}
+
+
+/*************************************************************************
+Bus
+*************************************************************************/
+void	SimPinChanged( void )
+{
+	MemPin	cs;
+	short	low;
+	short	i;
+	
+	for( i=0 ; i<NUM_CHIPS ; i++ )
+	{
+		cs = CSPin( i );
+		low = !(*cs.port & cs.mask);
+		
+		if( low && !Chips[i].selected )
+			SimSelect( &Chips[i] );
+		else if( !low && Chips[i].selected )
+			SimDeselect( &Chips[i] );
+	}
+}
+
+static uint8_t	SimXfer( uint8_t in )
+{
+	uint8_t	out = 0xFF;
+	short	sel = 0;
+	short	i;
+	
+	SimAdvance( ByteNs );
+	
+	for( i=0 ; i<NUM_CHIPS ; i++ )
+		if( Chips[i].selected )
+		{
+			out &= SimByte( &Chips[i], in );		//	Wired-AND, if it's a fight anyway
+			sel++;
+		}
+	
+	if( sel > 1 )
+		Contention++;
+	
+	return out;
+}
+
+short	SPI_Write_Byte( short byte )
+{
+	(void)SimXfer( (uint8_t)byte );
+	return 0;
+}
+
+short	SPI_Read_Byte( short ack, short* byte )
+{
+	(void)ack;
+	*byte = SimXfer( 0xFF );
+	return 0;
+}
+
+
+/*************************************************************************
+Set up / results
+*************************************************************************/
+//	Every chip blank, awake, unprotected and idle;  time and counts zeroed
+void	SimReset( void )
+{
+	short	i;
+	
+	memset( Chips, 0, sizeof(Chips) );
+	for( i=0 ; i<NUM_CHIPS ; i++ )
+		memset( Chips[i].mem, 0xFF, sizeof(Chips[i].mem) );
+	
+	PORTA = 0xFF;
+	PORTB = 0xFF;
+	Now = 0;
+	Contention = 0;
+}
+
+const SimStats*	SimGetStats( short chip )
+{
+	return &Chips[chip].stats;
+}
+
+void	SimClearStats( void )
+{
+	short	i;
+	
+	for( i=0 ; i<NUM_CHIPS ; i++ )
+		memset( &Chips[i].stats, 0, sizeof(SimStats) );
+	Contention = 0;
+}
+
+uint8_t*	SimMemory( short chip )
+{
+	return Chips[chip].mem;
+}
+
+unsigned long	SimContention( void )
+{
+	return Contention;
+}
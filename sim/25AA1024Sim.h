@@ -0,0 +1,66 @@
+/*
+ * _25AA1024Sim.h
+ *
+ * Host-side model of the 25AA1024
+ */ 
+
+/*************************************************************************
+Description:
+Runs the driver (and everything on top of it) on a PC against a 
+software model of up to NUM_CHIPS memories, so the higher layers can be
+benchmarked and tuned without hardware.
+
+sim/ replaces <avr/io.h>, <util/delay.h>, <util/crc16.h>, 
+<avr/interrupt.h> and TinySPI.h;  put it first on the include path and 
+build with the TinySPI transport (the default when there's no USI):
+	gcc -std=gnu99 -O2 -Isim -I. -o simdemo sim/25AA1024Sim.c \
+		sim/25AA1024SimDemo.c 25AA1024.c 25AA1024Vol.c 25AA1024Log.c \
+		25AA1024KV.c
+
+The model decodes READ, WRITE, WREN, WRDI, RDSR, WRSR, PE, SE, CE, RDID 
+and DPD, wraps writes inside the page, holds WIP for the write/erase 
+times below (only RDSR gets through while it's set), ignores writes and
+erases to block protected areas, and ignores everything but RDID in deep
+power-down.  !WP and !HOLD are not modelled.
+
+Time is simulated:  every bus byte costs 8 SCK periods, and _delay_us()/
+_delay_ms() just move the clock on.  CPU time on the host isn't counted,
+so the numbers are bus + wait time only.
+*************************************************************************/
+#include "25AA1024.h"
+
+
+#ifndef _25AA1024SIM_H_
+#define _25AA1024SIM_H_
+
+#ifndef SIM_SCK_HZ
+#define SIM_SCK_HZ		(F_CPU / 4)	//	Default bus clock
+#endif
+#ifndef SIM_TWC_US
+#define SIM_TWC_US		(MTWC * 1000UL)	//	Write cycle (datasheet max by default)
+#define SIM_TPE_US		(MTPE * 1000UL)	//	Page erase
+#define SIM_TSE_US		(MTSE * 1000UL)	//	Sector erase
+#define SIM_TCE_US		(MTCE * 1000UL)	//	Chip erase
+#endif
+
+typedef struct
+{
+	unsigned long	bytes;			//	Bytes clocked while selected
+	unsigned long	selects;		//	!CS low edges
+	unsigned long	commands[256];	//	Commands seen, by opcode
+	unsigned long	programs;		//	Page program cycles
+	unsigned long	erases;			//	Erase cycles (PE, SE or CE)
+	unsigned long	ignored;		//	Commands dropped (busy, asleep, no WEL, protected)
+	unsigned long	busyUs;			//	Time spent with WIP set
+} SimStats;
+
+//	Functions
+void			SimReset( void );
+void			SimSetSck( unsigned long hz );
+unsigned long	SimTimeUs( void );
+const SimStats*	SimGetStats( short chip );
+void			SimClearStats( void );
+uint8_t*		SimMemory( short chip );
+unsigned long	SimContention( void );
+
+#endif /* _25AA1024SIM_H_ */
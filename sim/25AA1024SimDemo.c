@@ -0,0 +1,104 @@
+/*
+ * _25AA1024SimDemo.c
+ *
+ * Runs a few workloads against the simulated memory and prints the cost
+ */ 
+
+/*************************************************************************
+Description:
+Example host program for the simulator (see 25AA1024Sim.h for the build 
+line).  Each workload prints simulated time, bus bytes, page programs 
+and erases, so changes to the driver or the layers above can be 
+compared quickly.
+*************************************************************************/
+#include "25AA1024Sim.h"
+#include "25AA1024KV.h"
+#include <stdio.h>
+#include <string.h>
+
+
+static uint8_t	Buf[4096];
+
+static void	Report( const char* name, unsigned long start )
+{
+	const SimStats*	s = SimGetStats( 0 );
+	
+	printf( "%-24s %9lu us %8lu bytes %6lu programs %5lu erases %5lu polls\n", name,
+			SimTimeUs() - start, s->bytes, s->programs, s->erases, s->commands[MRDSR] );
+	SimClearStats();
+}
+
+int	main( void )
+{
+	static MemKV	kv;
+	MemReader		rd;
+	unsigned long	t;
+	uint16_t		value;
+	short			len;
+	short			i;
+	
+	SimReset();
+	
+	if( InitMem( 0 ) || WakeMem( 0 ) || VolInit( VOL_LINEAR ) )
+	{
+		printf( "init failed\n" );
+		return 1;
+	}
+	
+	for( i=0 ; i<(short)sizeof(Buf) ; i++ )
+		Buf[i] = (uint8_t)i;
+	
+	t = SimTimeUs();
+	if( WriteBytes( 0, 0, sizeof(Buf), Buf ) )
+		printf( "WriteBytes failed\n" );
+	Report( "WriteBytes 4K", t );
+	
+	t = SimTimeUs();
+	memset( Buf, 0, sizeof(Buf) );
+	if( ReadBytes( 0, 0, sizeof(Buf), Buf ) || (Buf[4095] != 0xFF) )
+		printf( "ReadBytes failed\n" );
+	Report( "ReadBytes 4K", t );
+	
+	t = SimTimeUs();
+	ReaderOpen( &rd, 0 );
+	for( i=0 ; i<256 ; i++ )
+		ReaderRead( &rd, i * 16, 16, Buf );
+	ReaderClose( &rd );
+	Report( "ReaderRead 256 x 16", t );
+	
+	t = SimTimeUs();
+	if( EraseRange( 0, 0, SECTOR_SIZE ) )
+		printf( "EraseRange failed\n" );
+	Report( "EraseRange 1 sector", t );
+	
+	t = SimTimeUs();
+	if( KVFormat( &kv, 0, 64 ) )
+		printf( "KVFormat failed\n" );
+	Report( "KVFormat 64 pages", t );
+	
+	t = SimTimeUs();
+	for( i=0 ; i<1000 ; i++ )
+	{
+		value = i;
+		if( KVPut( &kv, i % 16, (const uint8_t*)&value, sizeof(value) ) )
+		{
+			printf( "KVPut failed at %d\n", i );
+			break;
+		}
+		KVService( &kv );
+	}
+	KVFlush( &kv );
+	Report( "KVPut 1000 x 2 bytes", t );
+	
+	t = SimTimeUs();
+	if( KVInit( &kv, 0, 64 ) )
+		printf( "KVInit failed\n" );
+	Report( "KVInit (remount)", t );
+	
+	//	Key k was last put at the last i < 1000 with i % 16 == k
+	for( i=0 ; i<16 ; i++ )
+		if( (KVGet( &kv, i, (uint8_t*)&value, sizeof(value), &len ) != MEMTRUE) || (value != ((992 + i < 1000) ? 992 + i : 976 + i)) )
+			printf( "key %d wrong\n", i );
+	
+	return 0;
+}
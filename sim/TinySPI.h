@@ -0,0 +1,17 @@
+/*
+ * TinySPI.h
+ *
+ * Host simulator stand-in for the TinySPI library
+ */ 
+
+#ifndef _SIM_TINYSPI_H_
+#define _SIM_TINYSPI_H_
+
+#define SPITRUE		1
+#define SPIFALSE	0
+
+//	Both go straight to the chip model (25AA1024Sim.c).  Return 0 on success.
+short	SPI_Write_Byte( short byte );
+short	SPI_Read_Byte( short ack, short* byte );
+
+#endif /* _SIM_TINYSPI_H_ */
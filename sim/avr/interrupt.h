@@ -0,0 +1,15 @@
+/*
+ * interrupt.h
+ *
+ * Host simulator stand-in for <avr/interrupt.h>
+ */ 
+
+#ifndef _SIM_AVR_INTERRUPT_H_
+#define _SIM_AVR_INTERRUPT_H_
+
+//	No interrupts on the host - ASYNC_USED isn't supported by the simulator
+#define ISR(v)		void v( void )
+#define sei()
+#define cli()
+
+#endif /* _SIM_AVR_INTERRUPT_H_ */
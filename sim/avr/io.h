@@ -0,0 +1,44 @@
+/*
+ * io.h
+ *
+ * Host simulator stand-in for <avr/io.h>
+ */ 
+
+/*************************************************************************
+Description:
+Just enough of <avr/io.h> for the driver to build on a PC.  The ports 
+are plain variables, and PINx IS PORTx, so the driver's pin readback 
+sees exactly what it wrote.
+
+MEMPIN_HOOK() (see 25AA1024.h) is pointed at the chip model, so it sees
+every !CS edge.
+*************************************************************************/
+#include <stdint.h>
+
+
+#ifndef _SIM_AVR_IO_H_
+#define _SIM_AVR_IO_H_
+
+extern volatile uint8_t	PORTA, DDRA;
+extern volatile uint8_t	PORTB, DDRB;
+
+#define PINA		PORTA
+#define PINB		PORTB
+
+#define PORTA0		0
+#define PORTA1		1
+#define PORTA2		2
+#define PORTA3		3
+#define PORTA4		4
+#define PORTA5		5
+#define PORTA6		6
+#define PORTA7		7
+#define PORTB0		0
+#define PORTB1		1
+#define PORTB2		2
+#define PORTB3		3
+
+void	SimPinChanged( void );
+#define MEMPIN_HOOK()	SimPinChanged()
+
+#endif /* _SIM_AVR_IO_H_ */
@@ -0,0 +1,22 @@
+/*
+ * crc16.h
+ *
+ * Host simulator stand-in for <util/crc16.h>
+ */ 
+
+#include <stdint.h>
+
+
+#ifndef _SIM_UTIL_CRC16_H_
+#define _SIM_UTIL_CRC16_H_
+
+//	Same as avr-libc's (CRC-CCITT, reflected, poly 0x8408)
+static inline uint16_t	_crc_ccitt_update( uint16_t crc, uint8_t data )
+{
+	data ^= (uint8_t)crc;
+	data ^= data << 4;
+	
+	return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
+
+#endif /* _SIM_UTIL_CRC16_H_ */
@@ -0,0 +1,14 @@
+/*
+ * delay.h
+ *
+ * Host simulator stand-in for <util/delay.h>
+ */ 
+
+#ifndef _SIM_UTIL_DELAY_H_
+#define _SIM_UTIL_DELAY_H_
+
+//	These don't wait - they move the simulated clock on (25AA1024Sim.c)
+void	_delay_us( double us );
+void	_delay_ms( double ms );
+
+#endif /* _SIM_UTIL_DELAY_H_ */